@@ -10,11 +10,14 @@
  **/
 
 #include "sign.h"
+#include <limits.h>
 #include <time.h>
+#include <unistd.h>
 #include <gmp.h>
 
 static mpz_t p;
 static mpz_t w;
+static mpz_t q;      /* Ordnung von w in einer Schnorr-Gruppe, 0: klassisch mod p-1 */
 
 const char *factorlist_hex[] = {
 	"5", "7", "9", "B", "D", "11","13","17","1D","1F","25","29",
@@ -27,17 +30,32 @@ const char *factorlist_hex[] = {
 };
 
 int nfactors;
-int debug = 0;
+
+/* Abstimmung von Baby-Step Giant-Step, siehe bsgs_choose_m() */
+unsigned long bsgs_m = 0;           /* feste Anzahl Baby-Steps, 0 = automatisch */
+unsigned long bsgs_mem_budget = 0;  /* max. Bytes pro Baby-Step-Tabelle, 0 = unbegrenzt */
+unsigned long bsgs_targets = 1;     /* erwartete Anzahl Ziele pro Tabelle */
+int bsgs_autotune = 0;              /* Kostenverhältnis vor der Wahl von m messen */
+static double bsgs_cost_ratio[] = { 1.0, 1.0, 1.0 };  /* Kosten Giant-Step / Baby-Step je BSGSKind */
+static int bsgs_tuned[] = { 0, 0, 0 };
+int bsgs_engine = 0;                /* >0: Giant-Steps mit der Vektor-Engine, so viele Läufe */
+
+#define GS_CHUNK       1024         /* Giant-Steps pro Vergabe an einen Lauf der Engine */
+#define BSGS_HASH(fp)  ((fp) ^ ((fp) >> 29))
+#define BSGS_FULL_MAX  (1UL << 16)  /* Untergruppen bis zu dieser Ordnung komplett tabellieren */
 mpz_t *factorlist;              /* Zugriff hierauf wie auf Array. Index 0<=i<nfactors */
 
 /*
  * init_factors() : Füllt die interne factorlist mit Faktoren.
+ *   Die Liste wird nur beim ersten Aufruf angelegt und danach wiederverwendet.
  */
 static void init_factors(void)
 {
 	int i;
 	mpz_t tmp;
 
+	if (factorlist)
+		return;
 	for (nfactors=0; factorlist_hex[nfactors]; nfactors++);
 	factorlist = calloc(nfactors, sizeof(mpz_t));
 	mpz_init(tmp);
@@ -46,11 +64,11 @@ static void init_factors(void)
 		mpz_init(factorlist[i]);
 		mpz_set_str(factorlist[i], factorlist_hex[i], 16);
 		mpz_mul(tmp, tmp, factorlist[i]);
-		if (debug)
-			gmp_printf("i=%d, factor=%Zd, tmp=%Zd\n", i, factorlist[i], tmp);
 	}
 	mpz_add_ui(tmp, tmp, 1);
+	TRACE(mpz_cmp(tmp, p) ? TRACE_ERROR : TRACE_INFO, T_FACTORS, nfactors, !mpz_cmp(tmp, p), 0);
 	if (mpz_cmp(tmp, p)) {
+		trace_dump(stderr);
 		printf ("FATAL: Faktoren stammen nicht von p-1!\n");
 		exit (1);
 	}
@@ -61,168 +79,699 @@ static void init_factors(void)
 	Compare function for qsort BSGSElements
 */
 int comparator(const void* a, const void* b) {
-	mpz_t g, h;
-	mpz_init_set(g, ((const BSGSElement*)a)->w_i);
-	mpz_init_set(h, ((const BSGSElement*)b)->w_i);
-	if (debug)
-		gmp_printf("a=%Zd, b=%Zd.\n", a, b);
-	return mpz_cmp(g, h);
+	return mpz_cmp(((const BSGSElement*)a)->w_i, ((const BSGSElement*)b)->w_i);
 }
 
 /*
- * babyStepGiantStep(mpz_t x_i, mpz_t a_i, mpz_t w_i, mpz_t p_i):
- *
- * Berechnet x_i so dass a_i = w_i ^ x_i mod p.
+ * bsgs_fp_slots(n) : Anzahl der Slots im Fingerabdruck-Hash für N Einträge,
+ *   die kleinste Zweierpotenz >= 2n (Füllgrad <= 1/2).
  */
-static void babyStepGiantStep(mpz_t x_i, mpz_t a_i, mpz_t w_i, mpz_t p_i)
+static unsigned long bsgs_fp_slots(unsigned long n)
 {
-	/*>>>>                                                <<<<*
-	 *>>>> AUFGABE: Implementierung von BabyStepGiantStep <<<<*
-	 *>>>>                                                <<<<*/
-	mpz_t q_i, inv_w_q, tmp;
-	mpz_init(q_i);
-	mpz_sqrt(q_i, p_i);
-	mpz_add_ui(q_i, q_i, 1);  // lets go on number safer.
-	if (debug)
-		gmp_printf("%Zd Elemente.\n", q_i);
-
-	// this will be out list (w^i, i) for the baby steps
-	BSGSElement* list;
-	list = malloc(mpz_get_ui(q_i) * sizeof(BSGSElement));
-	mpz_init_set_ui(list[0].w_i, 1);
-	list[0].index = 0;
-	if (debug)
-		gmp_printf("%d. Adding %Zd.\n", 0, list[0].w_i);
+	unsigned long slots = 2;
 
-	int i;
-	for (i = 1; i < mpz_get_ui(q_i); i++) {
-		list[i].index = i;
-		mpz_init(list[i].w_i);
-		mpz_mul(list[i].w_i, list[i-1].w_i, w_i); //gmp_printf("%Zd * %Zd = %Zd.\n%Zd mod %Zd", list[i].w_i, w_i, list[i+1].w_i, list[i+1].w_i, p);
-		mpz_mod(list[i].w_i, list[i].w_i, p); //gmp_printf(" = %Zd.\n", list[i+1].w_i);
-		if (debug)
-			gmp_printf("%d. Adding %Zd.\n", i, list[i].w_i);
-	}
-	if (debug) {
-		for (int i = 0; i < mpz_get_ui(q_i); i++) {
-			gmp_printf("%d. %Zd\n", list[i].index, list[i].w_i);
+	while (slots < 2 * n)
+		slots <<= 1;
+	return slots;
+}
+
+/*
+ * bsgs_fp_alloc(t, n) / bsgs_fp_insert(t, fp, v) : Hash über die untersten
+ *   64 Bit mit offener Adressierung für N Einträge (Füllgrad <= 1/2).
+ */
+static void bsgs_fp_alloc(BSGSTable *t, unsigned long n)
+{
+	unsigned long slots = bsgs_fp_slots(n);
+
+	t->fp_mask = slots - 1;
+	t->fp_key = malloc(slots * sizeof(uint64_t));
+	t->fp_pos = calloc(slots, sizeof(unsigned long));
+}
+
+static void bsgs_fp_insert(BSGSTable *t, uint64_t fp, unsigned long v)
+{
+	unsigned long h;
+
+	for (h = BSGS_HASH(fp) & t->fp_mask; t->fp_pos[h]; h = (h + 1) & t->fp_mask);
+	t->fp_key[h] = fp;
+	t->fp_pos[h] = v + 1;
+}
+
+/*
+ * bsgs_table_bytes(kind, m) : Speicherbedarf einer Tabelle mit M Baby-Steps
+ *   in Bytes. BSGS_GENERIC: pro Eintrag Element, Limbs eines Restes mod p und
+ *   malloc-Overhead, mit Vektor-Engine zusätzlich der Hash aus
+ *   bsgs_table_index(); sonst nur der Hash.
+ */
+static unsigned long bsgs_table_bytes(BSGSKind kind, unsigned long m)
+{
+	unsigned long hash = bsgs_fp_slots(m) * (sizeof(uint64_t) + sizeof(unsigned long));
+
+	if (kind != BSGS_GENERIC)
+		return hash;
+	return m * (sizeof(BSGSElement) + mpz_size(p) * sizeof(mp_limb_t) + 16) + (bsgs_engine ? hash : 0);
+}
+
+/*
+ * bsgs_max_m(kind) : Größtes m, dessen Tabelle in bsgs_mem_budget paßt
+ *   (0, wenn nicht einmal eine Tabelle mit einem Eintrag paßt).
+ */
+static unsigned long bsgs_max_m(BSGSKind kind)
+{
+	unsigned long lo = 0, hi = bsgs_mem_budget / sizeof(uint64_t), mid;
+
+	while (lo < hi) {              // bsgs_table_bytes() grows with m
+		mid = hi - (hi - lo) / 2;
+		if (bsgs_table_bytes(kind, mid) <= bsgs_mem_budget)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return lo;
+}
+
+/*
+ * bsgs_kind(p_i) : Wählt den Kern für eine Untergruppe der Ordnung p_i.
+ *   Kleine Ordnungen werden komplett tabelliert (sofern das Speicherbudget
+ *   reicht), bis 2^64 reichen 64-Bit-Fingerabdrücke, darüber bleibt die
+ *   sortierte mpz-Liste.
+ */
+static BSGSKind bsgs_kind(mpz_t p_i)
+{
+	if (mpz_cmp_ui(p_i, BSGS_FULL_MAX) < 0 &&
+			(!bsgs_mem_budget || bsgs_table_bytes(BSGS_FULL, mpz_get_ui(p_i)) <= bsgs_mem_budget))
+		return BSGS_FULL;
+	if (mpz_sizeinbase(p_i, 2) <= 64)
+		return BSGS_FP64;
+	return BSGS_GENERIC;
+}
+
+/*
+ * wall_clock() : Monotone Uhr in Sekunden, für Laufzeitmessungen.
+ */
+static double wall_clock(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * bsgs_tune(kind) : Misst für den Kern KIND die Kosten eines Baby-Steps
+ *   (Multiplikation, Reduktion und anteiliges Sortieren bzw. Eintragen in
+ *   den Hash) und eines Giant-Steps (Multiplikation, Reduktion und Suche)
+ *   für das aktuelle p und setzt bsgs_cost_ratio[kind].
+ */
+static void bsgs_tune(BSGSKind kind)
+{
+	const unsigned long n = 4096;
+	BSGSElement *list = NULL, key;
+	BSGSTable t = { 0 };
+	uint64_t fp;
+	mpz_t tmp;
+	double t0, t_ins, t_gs;
+	unsigned long i, h;
+	MPArenaMark mark = mp_arena_mark();
+
+	mpz_init_set_ui(tmp, 1);
+	t0 = wall_clock();
+	if (kind == BSGS_GENERIC) {
+		list = malloc(n * sizeof(BSGSElement));
+		for (i = 0; i < n; i++) {
+			list[i].index = i;
+			mpz_init_set(list[i].w_i, tmp);
+			mpz_mul(tmp, tmp, w);
+			mpz_mod(tmp, tmp, p);
+		}
+		qsort((void*)list, n, sizeof(list[0]), comparator);
+	} else {
+		bsgs_fp_alloc(&t, n);
+		for (i = 0; i < n; i++) {
+			bsgs_fp_insert(&t, TRACE_FP(tmp), i);
+			mpz_mul(tmp, tmp, w);
+			mpz_mod(tmp, tmp, p);
+		}
+	}
+	t_ins = wall_clock() - t0;
+
+	// tmp = w^n is not in the table, so every search is a miss as in a real walk
+	mpz_init(key.w_i);
+	t0 = wall_clock();
+	for (i = 0; i < n; i++) {
+		if (kind == BSGS_GENERIC) {
+			mpz_set(key.w_i, tmp);
+			bsearch(&key, list, n, sizeof(BSGSElement), comparator);
+		} else {
+			fp = TRACE_FP(tmp);
+			for (h = BSGS_HASH(fp) & t.fp_mask; t.fp_pos[h] && t.fp_key[h] != fp; h = (h + 1) & t.fp_mask);
 		}
+		mpz_mul(tmp, tmp, w);
+		mpz_mod(tmp, tmp, p);
+	}
+	t_gs = wall_clock() - t0;
+
+	bsgs_cost_ratio[kind] = (t_ins > 0 && t_gs > 0) ? t_gs / t_ins : 1.0;
+	bsgs_tuned[kind] = 1;
+	TRACE(TRACE_INFO, T_BSGS_TUNE, t_ins * 1e9 / n, t_gs * 1e9 / n, bsgs_cost_ratio[kind] * 1000);
+
+	if (kind == BSGS_GENERIC) {
+		for (i = 0; i < n; i++)
+			mpz_clear(list[i].w_i);
+		free(list);
+	} else {
+		free(t.fp_key);
+		free(t.fp_pos);
+	}
+	mpz_clears(key.w_i, tmp, NULL);
+	mp_arena_release(mark);
+}
+
+/*
+ * bsgs_choose_m(p_i, ntargets) : Wählt die Anzahl der Baby-Steps m für
+ *   eine Untergruppe der Ordnung p_i, in der ntargets Logarithmen gesucht werden.
+ *
+ *   Gesamtkosten m * c_ins + ntargets * (p_i / m) * c_gs werden minimal für
+ *   m = sqrt(ntargets * p_i * c_gs / c_ins). Ein fest vorgegebenes bsgs_m hat
+ *   Vorrang; bsgs_mem_budget begrenzt m in jedem Fall nach oben.
+ */
+static unsigned long bsgs_choose_m(mpz_t p_i, unsigned long ntargets)
+{
+	mpz_t tmp;
+	unsigned long m;
+	BSGSKind kind = bsgs_kind(p_i);
+
+	if (kind == BSGS_FULL)             // complete table, m is not a choice
+		return mpz_get_ui(p_i);
+	if (bsgs_autotune && !bsgs_tuned[kind])
+		bsgs_tune(kind);
+
+	mpz_init(tmp);
+	if (bsgs_m) {
+		mpz_set_ui(tmp, bsgs_m);
+	} else {
+		mpz_mul_ui(tmp, p_i, ntargets ? ntargets : 1);
+		mpz_mul_ui(tmp, tmp, (unsigned long)(bsgs_cost_ratio[kind] * 1024 + 0.5) + 1);
+		mpz_tdiv_q_2exp(tmp, tmp, 10);
+		mpz_sqrt(tmp, tmp);
+		mpz_add_ui(tmp, tmp, 1);
 	}
-	qsort((void*)list, mpz_get_ui(q_i), sizeof(list[0]), comparator);	// sort list for values, not indices
-	if (debug) {
-		for (int i = 0; i < mpz_get_ui(q_i); i++) {
-			gmp_printf("%d. %Zd\n", list[i].index, list[i].w_i);
+	if (mpz_cmp(tmp, p_i) > 0)          // more baby steps than group elements are useless
+		mpz_set(tmp, p_i);
+	if (!mpz_fits_ulong_p(tmp)) {
+		printf("FATAL: Untergruppe zu groß für Baby-Step Giant-Step!\n");
+		exit(1);
+	}
+	m = mpz_get_ui(tmp);
+	if (bsgs_mem_budget && bsgs_table_bytes(kind, m) > bsgs_mem_budget)
+		m = bsgs_max_m(kind);
+	if (m == 0)                        // budget below one entry: smallest possible table
+		m = 1;
+	mpz_clear(tmp);
+	return m;
+}
+
+/*
+ * bsgs_table_init(t, w_i, p_i, m) :
+ *
+ * Berechnet die m Baby-Steps (w_i^j, j) mit 0 <= j < m und bereitet den
+ * Giant-Step-Faktor (w_i^m)^(-1) mod p vor. Je nach Kern (bsgs_kind())
+ * werden die w_i^j als mpz-Liste nach dem Wert sortiert (BSGS_GENERIC) oder
+ * nur ihre Fingerabdrücke in den Hash eingetragen. BSGS_FULL ignoriert m und
+ * tabelliert die ganze Untergruppe, dann ist ein Giant-Step genug.
+ */
+static void bsgs_table_init(BSGSTable *t, mpz_t w_i, mpz_t p_i, unsigned long m)
+{
+	unsigned long i;
+	mpz_t tmp;
+
+	t->kind = bsgs_kind(p_i);
+	if (t->kind == BSGS_FULL)
+		m = mpz_get_ui(p_i);
+	t->m = m;
+	t->list = NULL;
+	t->fp_key = NULL;
+	t->fp_pos = NULL;
+	mpz_init_set(t->w_i, w_i);
+	mpz_init(tmp);
+	mpz_cdiv_q_ui(tmp, p_i, m);
+	t->steps = mpz_fits_ulong_p(tmp) ? mpz_get_ui(tmp) : ULONG_MAX;  // tiny m under -M for a big p_i
+	TRACE(TRACE_DEBUG, T_BSGS_TABLE, t->m, t->steps, TRACE_FP(p_i));
+
+	if (t->kind != BSGS_GENERIC) {
+		// only the fingerprints are kept, hits are checked with w_i^j in bsgs_fp_check();
+		// inserting is part of M_BSGS_BABY here, it is too cheap to time on its own
+		uint64_t fp;
+		bsgs_fp_alloc(t, m);
+		mpz_set_ui(tmp, 1);
+		METRIC_START(t0);
+		for (i = 0; i < m; i++) {
+			fp = TRACE_FP(tmp);
+			TRACE_STEP(T_BSGS_BABY, i, fp);
+			bsgs_fp_insert(t, fp, i);
+			mpz_mul(tmp, tmp, w_i);
+			mpz_mod(tmp, tmp, p);
 		}
+		METRIC_STOP(M_BSGS_BABY, t0, m);
+		// tmp = w_i^m, for BSGS_FULL that is 1 and there is only one giant step
+		mpz_init(t->inv_w_m);
+		mpz_invert(t->inv_w_m, tmp, p);
+		mpz_clear(tmp);
+		return;
 	}
-	mpz_init_set(inv_w_q, w_i);
-	mpz_powm(inv_w_q, inv_w_q, q_i, p);	// compute (w_i ^ q_i mod p)^(-1)
-	if (debug)
-		gmp_printf("Inverse of %Zd is ", inv_w_q);
-	mpz_invert(inv_w_q, inv_w_q, p);
-	if (debug)
-		gmp_printf("%Zd.\n", inv_w_q);
+	mpz_clear(tmp);
 
-	mpz_init_set(tmp, a_i);
-	BSGSElement* bsgs_tmp = malloc(sizeof(BSGSElement));
-	mpz_init(bsgs_tmp->w_i);
+	// this will be our list (w^i, i) for the baby steps
+	t->list = malloc(m * sizeof(BSGSElement));
+	mpz_init_set_ui(t->list[0].w_i, 1);
+	t->list[0].index = 0;
+
+	METRIC_START(t0);
+	for (i = 1; i < m; i++) {
+		t->list[i].index = i;
+		mpz_init(t->list[i].w_i);
+		mpz_mul(t->list[i].w_i, t->list[i-1].w_i, w_i);
+		mpz_mod(t->list[i].w_i, t->list[i].w_i, p);
+		TRACE_STEP(T_BSGS_BABY, i, TRACE_FP(t->list[i].w_i));
+	}
+	METRIC_STOP(M_BSGS_BABY, t0, m);
+	METRIC_START(t1);
+	qsort((void*)t->list, m, sizeof(t->list[0]), comparator);	// sort list for values, not indices
+	METRIC_STOP(M_BSGS_INSERT, t1, m);
+	mpz_init_set(t->inv_w_m, w_i);
+	mpz_powm_ui(t->inv_w_m, t->inv_w_m, m, p);	// compute (w_i ^ m mod p)^(-1)
+	mpz_invert(t->inv_w_m, t->inv_w_m, p);
+}
 
+static void bsgs_table_clear(BSGSTable *t)
+{
+	unsigned long i;
 
-	BSGSElement* j;
-	for (i = 0; i < mpz_get_ui(q_i); i++) {
+	if (t->list) {
+		for (i = 0; i < t->m; i++)
+			mpz_clear(t->list[i].w_i);
+		free(t->list);
+	}
+	free(t->fp_key);
+	free(t->fp_pos);
+	mpz_clears(t->w_i, t->inv_w_m, NULL);
+}
+
+/*
+ * bsgs_table_index(t) : Legt zu einer BSGS_GENERIC-Tabelle T den Hash über
+ *   die untersten 64 Bit der Baby-Steps an, damit die Läufe der Vektor-Engine
+ *   ohne Umweg über mpz_t gesucht werden können. Die anderen Kerne haben
+ *   den Hash schon.
+ */
+static void bsgs_table_index(BSGSTable *t)
+{
+	unsigned long i;
+
+	if (t->fp_key)
+		return;
+	bsgs_fp_alloc(t, t->m);
+	for (i = 0; i < t->m; i++)
+		bsgs_fp_insert(t, TRACE_FP(t->list[i].w_i), i);
+}
+
+/*
+ * bsgs_fp_check(t, slot, val, i, x_i) : Prüft einen Treffer im Hash von T
+ *   für den Wert VAL nach I Giant-Steps.
+ *
+ * RETURN-Code: 1 und x_i = i * m + j, wenn VAL = w_i ^ j, 0 sonst.
+ */
+static int bsgs_fp_check(BSGSTable *t, unsigned long slot, mpz_t val, unsigned long i, mpz_t x_i)
+{
+	unsigned long j = t->fp_pos[slot] - 1;
+	mpz_t tmp;
+	int ok;
+
+	if (t->kind == BSGS_GENERIC) {
+		if (mpz_cmp(val, t->list[j].w_i))
+			return 0;
+		j = t->list[j].index;
+	}
+	else {                       // the table only had the lowest 64 bits: val = w_i^j?
+		mpz_init(tmp);
+		mpz_powm_ui(tmp, t->w_i, j, p);
+		ok = !mpz_cmp(tmp, val);
+		mpz_clear(tmp);
+		if (!ok)
+			return 0;
+	}
+	mpz_set_ui(x_i, t->m);
+	mpz_mul_ui(x_i, x_i, i);
+	mpz_add_ui(x_i, x_i, j);
+	TRACE(TRACE_DEBUG, T_BSGS_FOUND, mpz_get_ui(x_i), i, j);
+	return 1;
+}
+
+/*
+ * bsgs_lane_find(t, b, lane, i, x_i, tmp) : Sucht den aktuellen Wert von
+ *   Lauf LANE der Engine B nach I Giant-Steps im Hash der Tabelle T. Nur bei
+ *   passendem Fingerabdruck wird der Wert nach TMP geholt und geprüft.
+ *
+ * RETURN-Code: 1, wenn x_i gefunden wurde, 0 sonst.
+ */
+static int bsgs_lane_find(BSGSTable *t, GSBatch *b, int lane, unsigned long i, mpz_t x_i, mpz_t tmp)
+{
+	uint64_t fp = gs_fp(b, lane);
+	unsigned long h;
+
+	for (h = BSGS_HASH(fp) & t->fp_mask; t->fp_pos[h]; h = (h + 1) & t->fp_mask) {
+		if (t->fp_key[h] != fp)
+			continue;
+		gs_get(b, lane, tmp);
+		if (bsgs_fp_check(t, h, tmp, i, x_i))
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * bsgs_table_solve(t, x_i, a_i) :
+ *
+ * Giant-Steps a_i * (w_i^(-m))^i gegen die Tabelle T, gesucht wird mit
+ * bsearch() in der Liste oder über die Fingerabdrücke im Hash.
+ * RETURN-Code: 1, wenn x_i mit a_i = w_i ^ x_i mod p gefunden wurde, 0 sonst.
+ */
+static int bsgs_table_solve(BSGSTable *t, mpz_t x_i, mpz_t a_i)
+{
+	/*>>>>                                                <<<<*
+	 *>>>> AUFGABE: Implementierung von BabyStepGiantStep <<<<*
+	 *>>>>                                                <<<<*/
+	BSGSElement key, *j;
+	unsigned long i, h;
+	uint64_t fp;
+	int found = 0;
+
+	mpz_init_set(key.w_i, a_i);
+	METRIC_START(t0);
+	for (i = 0; i < t->steps; i++) {
 		// search for tmp in our list
-		mpz_set(bsgs_tmp->w_i, tmp);
-		if (debug)
-			gmp_printf("%d. Searching for: %Zd.\n", i, tmp);
-		j = (BSGSElement*) bsearch(bsgs_tmp, list, mpz_get_ui(q_i), sizeof(BSGSElement), comparator);
-		if (j != NULL) {
-			if (debug)
-				gmp_printf("Found a y_i and a z_i which satisfies x_i [=] y_i + q_i * z_i : %d + %d * %Zd = ", j->index, i, q_i);
-			mpz_mul_ui(q_i, q_i, i);
-			mpz_add_ui(q_i, q_i, j->index);
-			mpz_set(x_i, q_i);
-			if (debug)
-				gmp_printf("%Zd.\n", x_i);
-			break;
+		TRACE_STEP(T_BSGS_GIANT, i, TRACE_FP(key.w_i));
+		if (t->kind == BSGS_GENERIC) {
+			j = (BSGSElement*) bsearch(&key, t->list, t->m, sizeof(BSGSElement), comparator);
+			if (j != NULL) {
+				// x_i [=] y_i + m * z_i with y_i = j->index and z_i = i
+				mpz_set_ui(x_i, t->m);
+				mpz_mul_ui(x_i, x_i, i);
+				mpz_add_ui(x_i, x_i, j->index);
+				TRACE(TRACE_DEBUG, T_BSGS_FOUND, mpz_get_ui(x_i), i, j->index);
+				found = 1;
+				break;
+			}
+		} else {
+			fp = TRACE_FP(key.w_i);
+			for (h = BSGS_HASH(fp) & t->fp_mask; t->fp_pos[h] && !found; h = (h + 1) & t->fp_mask)
+				found = t->fp_key[h] == fp && bsgs_fp_check(t, h, key.w_i, i, x_i);
+			if (found)
+				break;
 		}
+		if (i + 1 == t->steps)           // the last giant step needs no update
+			break;
 		// not found. update tmp
-		mpz_mul(tmp, tmp, inv_w_q);
+		mpz_mul(key.w_i, key.w_i, t->inv_w_m);
+		mpz_mod(key.w_i, key.w_i, p);
+	}
+	METRIC_STOP(M_BSGS_GIANT, t0, found ? i + 1 : t->steps);
+	if (!found)                          // the caller dumps the trace, see dlog_solve()
+		TRACE(TRACE_ERROR, T_BSGS_FAIL, t->steps, t->m, TRACE_FP(a_i));
+	mpz_clear(key.w_i);
+	return found;
+}
+
+/*
+ * gs_assign(b, walks, n, cur, lane, pos, end, tmp) : Gibt Lauf LANE das
+ *   nächste Stück von GS_CHUNK Giant-Steps ab walks[*cur].
+ *
+ * RETURN-Code: Index des Laufs in WALKS, -1 wenn nichts mehr zu vergeben ist.
+ */
+static int gs_assign(GSBatch *b, GSWalk *walks, int n, int *cur, int lane,
+		unsigned long *pos, unsigned long *end, mpz_t tmp)
+{
+	GSWalk *wk;
+
+	for (; *cur < n; (*cur)++) {
+		wk = &walks[*cur];
+		if (wk->solved || wk->next >= wk->t->steps)
+			continue;
+		pos[lane] = wk->next;
+		end[lane] = wk->t->steps - wk->next > GS_CHUNK ? wk->next + GS_CHUNK : wk->t->steps;
+		wk->next = end[lane];
+		mpz_powm_ui(tmp, wk->t->inv_w_m, pos[lane], p);   // start at a_i * (w_i^(-m))^pos
+		mpz_mul(tmp, tmp, wk->a_i);
 		mpz_mod(tmp, tmp, p);
+		gs_set(b, lane, tmp, wk->t->inv_w_m);
+		return *cur;
 	}
-	mpz_clears(q_i, inv_w_q, tmp, NULL);
+	return -1;
 }
 
 /*
- * dlogP(x, y):
+ * bsgs_solve_walks(walks, n) :
  *
- * Berechnet x, wobei y = w ^ x mod p mithilfe der Faktorisierung von p - 1.
+ * Löst die Giant-Step-Läufe WALKS[0..n-1] gegen ihre (indizierten) Tabellen
+ * mit der Vektor-Engine aus gstep.c. Jeder Lauf wird in Stücke zu GS_CHUNK
+ * Giant-Steps zerlegt und auf die bsgs_engine Läufe der Engine verteilt, so
+ * rechnen auch bei wenigen großen Untergruppen alle Läufe mit.
+ *
+ * Läufe, die schon als gelöst markiert sind, werden übersprungen.
+ *
+ * RETURN-Code: Anzahl der hier gelösten Läufe.
  */
-static void dlogP(mpz_t x, mpz_t y)
+static int bsgs_solve_walks(GSWalk *walks, int n)
+{
+	GSBatch b;
+	GSWalk *wk;
+	int *lw, lane, cur = 0, active, solved = 0, k;
+	unsigned long *pos, *end, steps = 0;
+	mpz_t tmp;
+
+	gs_init(&b, p, bsgs_engine);
+	lw = malloc(b.K * sizeof(int));
+	pos = malloc(b.K * sizeof(unsigned long));
+	end = malloc(b.K * sizeof(unsigned long));
+	mpz_init(tmp);
+	for (lane = 0; lane < b.K; lane++)
+		lw[lane] = gs_assign(&b, walks, n, &cur, lane, pos, end, tmp);
+
+	METRIC_START(t0);
+	for (;;) {
+		// look up every lane, hand out new work to lanes that are done
+		for (lane = 0, active = 0; lane < b.K; lane++) {
+			while (lw[lane] >= 0) {
+				wk = &walks[lw[lane]];
+				if (!wk->solved && pos[lane] < end[lane]) {
+					TRACE_STEP(T_BSGS_GIANT, pos[lane], gs_fp(&b, lane));
+					if (!bsgs_lane_find(wk->t, &b, lane, pos[lane], wk->x_i, tmp))
+						break;
+					wk->solved = 1;
+					solved++;
+				}
+				lw[lane] = gs_assign(&b, walks, n, &cur, lane, pos, end, tmp);
+			}
+			if (lw[lane] >= 0)
+				active++;
+		}
+		if (!active)
+			break;
+		gs_step(&b);
+		steps += active;
+		for (lane = 0; lane < b.K; lane++)
+			if (lw[lane] >= 0)
+				pos[lane]++;
+	}
+	METRIC_STOP(M_BSGS_GIANT, t0, steps);
+
+	for (k = 0; k < n; k++)
+		if (!walks[k].solved)
+			TRACE(TRACE_ERROR, T_BSGS_FAIL, walks[k].t->steps, walks[k].t->m, TRACE_FP(walks[k].a_i));
+	mpz_clear(tmp);
+	free(lw);
+	free(pos);
+	free(end);
+	gs_clear(&b);
+	return solved;
+}
+
+/*
+ * dlog_init(c) : Berechnet einmal alles, was beim Logarithmus in der
+ *   Gruppe mod p nicht vom Ziel y abhängt: Faktorisierung von p-1, die
+ *   Erzeuger w_i der Untergruppen mit ihren Baby-Step-Tabellen und die
+ *   CRT-Koeffizienten. Die Tabellen sind für bsgs_targets Ziele bemessen.
+ */
+static void dlog_init(DlogContext *c)
 {
+	int i;
+	mpz_t tmp, n_i;
+
 	init_factors();
-	/*>>>>                                            <<<<*
-	 *>>>> AUFGABE: Berechnen des geheimen Schlüssels <<<<*
-	 *>>>>                                            <<<<*/
+	c->n = nfactors;
+	c->e_i = calloc(c->n, sizeof(mpz_t));
+	c->crt_c = calloc(c->n, sizeof(mpz_t));
+	c->tabs = calloc(c->n, sizeof(BSGSTable));
+	c->walks = calloc(c->n, sizeof(GSWalk));
+	mpz_init(c->p_1);
+	mpz_sub_ui(c->p_1, p, 1);
+	mpz_inits(tmp, n_i, NULL);
+
+	for (i = 0; i < c->n; i++) {
+		mpz_init(c->e_i[i]);
+		mpz_divexact(c->e_i[i], c->p_1, factorlist[i]);   // e_i = (p-1) / p_i
+		mpz_powm(tmp, w, c->e_i[i], p);                   // w_i = w ^ e_i mod p
+		bsgs_table_init(&c->tabs[i], tmp, factorlist[i], bsgs_choose_m(factorlist[i], bsgs_targets));
+		if (bsgs_engine)
+			bsgs_table_index(&c->tabs[i]);
+		c->walks[i].t = &c->tabs[i];
+		mpz_init2(c->walks[i].a_i, mpz_sizeinbase(p, 2) + GMP_NUMB_BITS);
+
+		// x = sum x_i * c_i mod (p-1) with c_i = e_i * (e_i^(-1) mod p_i)
+		mpz_init(c->crt_c[i]);
+		mpz_invert(n_i, c->e_i[i], factorlist[i]);
+		mpz_mul(c->crt_c[i], c->e_i[i], n_i);
+	}
+	mpz_clears(tmp, n_i, NULL);
+}
+
+static void dlog_clear(DlogContext *c)
+{
 	int i;
-	mpz_t p_1, tmp, a_i, w_i, p_i, inv;
-	mpz_t* x_is = malloc(nfactors * sizeof(mpz_t));
-	mpz_t* crt_x_is = malloc(nfactors * sizeof(mpz_t));
-	mpz_init(p_1);
-	mpz_init(a_i);
-	mpz_init(w_i);
-	mpz_init(p_i);
-	mpz_init(inv);
-	mpz_init_set_ui(tmp, 0);
-	mpz_sub_ui(p_1, p, 1);
 
-	for (i = 0; i < nfactors; i++) {
-		mpz_set(p_i, factorlist[i]);
-		mpz_div(tmp, p_1, p_i);      // tmp = p-1 / p_i
-		mpz_powm(w_i, w, tmp, p);	 // w_i = w ^ (p-1 / p_i) mod p
-		mpz_mul(tmp, tmp, tmp);      // tmp = (p-1 / p_i)²
-		mpz_powm(a_i, y, tmp, p);	 // a_i = a ^ (p-1 / p_i)² mod p
-		if (debug)
-			gmp_printf("%d. BSGS for a_i=%Zd, w_i=%Zd, p_i=%Zd.\n With p=%Zd\n", i, a_i, w_i, p_i, p);
-		mpz_init(x_is[i]);
-		babyStepGiantStep(x_is[i], a_i, w_i, p_i);
+	for (i = 0; i < c->n; i++) {
+		bsgs_table_clear(&c->tabs[i]);
+		mpz_clears(c->e_i[i], c->crt_c[i], c->walks[i].a_i, NULL);
 	}
-	if (debug) {
-		for (i = 0; i < nfactors; i++) {
-			gmp_printf("prime[%d] = %Zd. x[%d] = %Zd.\n", i, factorlist[i], i, x_is[i]);
+	mpz_clear(c->p_1);
+	free(c->e_i);
+	free(c->crt_c);
+	free(c->tabs);
+	free(c->walks);
+}
+
+/*
+ * dlog_solve(c, x, y):
+ *
+ * Berechnet x, wobei y = w ^ x mod p, mit den vorberechneten Daten aus C.
+ * Pro Ziel bleiben eine Exponentiation und die Giant-Steps je Faktor.
+ *
+ * RETURN-Code: 1, wenn alle Teil-Logarithmen gefunden wurden, 0 sonst.
+ */
+static int dlog_solve(DlogContext *c, mpz_t x, mpz_t y)
+{
+	int i, found = 0;
+	mpz_t a_i, sum;
+	MPArenaMark mark;
+
+	mpz_realloc2(x, mpz_sizeinbase(p, 2) + GMP_NUMB_BITS);  // x outlives the arena scope
+	mark = mp_arena_mark();
+	mpz_t* x_is = mp_arena_alloc(c->n * sizeof(mpz_t));
+	mpz_inits(a_i, sum, NULL);
+
+	for (i = 0; i < c->n; i++) {
+		mpz_init(x_is[i]);
+		mpz_powm(a_i, y, c->e_i[i], p);      // a_i = y ^ e_i = w_i ^ (x mod p_i)
+		TRACE(TRACE_DEBUG, T_DLOG_FACTOR, i, TRACE_FP(factorlist[i]), TRACE_FP(a_i));
+		if (bsgs_engine && c->tabs[i].kind != BSGS_FULL) {  // walk these together below
+			mpz_realloc2(x_is[i], mpz_sizeinbase(factorlist[i], 2) + GMP_NUMB_BITS);
+			mpz_set(c->walks[i].a_i, a_i);
+			c->walks[i].x_i = x_is[i];
+			c->walks[i].next = 0;
+			c->walks[i].solved = 0;
+		} else {                             // complete tables need a single lookup
+			found += bsgs_table_solve(&c->tabs[i], x_is[i], a_i);
+			c->walks[i].solved = 1;
 		}
 	}
+	if (bsgs_engine)
+		found += bsgs_solve_walks(c->walks, c->n);
+
 	// now we got our crt-values, time to do some math
-	for (i = 0; i < nfactors; i++) {
-		mpz_init(crt_x_is[i]);
-		mpz_div(tmp, p_1, factorlist[i]);						// compute tmp = (p-1) / p_i
-		mpz_invert(tmp, tmp, factorlist[i]);					// tmp^(-1)
-		mpz_mul(crt_x_is[i], x_is[i], tmp);						// x_i * tmp^(-1)
-		mpz_mod(crt_x_is[i], crt_x_is[i], factorlist[i]);		// x_i * tmp^(-1) mod p_i
-		if (debug)
-			gmp_printf("%d. x = %Zd mod %Zd.\n", i, crt_x_is[i], factorlist[i]);
-	}
-	mpz_t x_p, x_q, p_inv, z, p_q;
-	mpz_init(x_p); mpz_init(x_q); mpz_init(p_inv); mpz_init(z); mpz_init(p_q);
-	
-	mpz_mod(z, x_is[0], factorlist[0]);
-	mpz_set(p_q, factorlist[0]);
+	METRIC_START(t0);
+	for (i = 0; i < c->n; i++) {
+		mpz_mul(a_i, x_is[i], c->crt_c[i]);
+		mpz_add(sum, sum, a_i);
+		TRACE(TRACE_DEBUG, T_DLOG_CRT, i, TRACE_FP(x_is[i]), TRACE_FP(factorlist[i]));
+	}
+	mpz_mod(x, sum, c->p_1);
+	METRIC_STOP(M_CRT, t0, c->n);
+	TRACE(TRACE_INFO, T_DLOG_RESULT, TRACE_FP(x), mpz_sizeinbase(x, 2), 0);
+	if (found != c->n)                   // one dump with all failed factors
+		trace_dump(stderr);
+
+	for (i = 0; i < c->n; i++)
+		mpz_clear(x_is[i]);
+	mpz_clears(a_i, sum, NULL);
+	mp_arena_release(mark);
+	return found == c->n;
+}
+
+/*
+ * dlogP(x, y):
+ *
+ * Berechnet x, wobei y = w ^ x mod p mithilfe der Faktorisierung von p - 1.
+ * Die Vorberechnung aus dlog_init() wird beim ersten Aufruf angelegt und
+ * für alle weiteren Aufrufe wiederverwendet.
+ */
+static void dlogP(mpz_t x, mpz_t y)
+{
+	/*>>>>                                            <<<<*
+	 *>>>> AUFGABE: Berechnen des geheimen Schlüssels <<<<*
+	 *>>>>                                            <<<<*/
+	static DlogContext ctx;
+	static int ctx_ready = 0;
 
-	mpz_t p, prod, sum;
-	mpz_init(p); mpz_init_set_ui(prod, 1); mpz_init_set_ui(sum, 0);
+	if (!ctx_ready) {
+		dlog_init(&ctx);
+		ctx_ready = 1;
+	}
+	dlog_solve(&ctx, x, y);
+}
 
-	for (i = 0; i < nfactors; i++)
-		mpz_mul(prod, prod, factorlist[i]);
+/*
+ * dlog_batch(keyfile) :
+ *
+ * Audit-Modus: berechnet für alle öffentlichen Schlüssel aus KEYFILE den
+ * geheimen Schlüssel. Faktorisierung, Erzeuger und Baby-Step-Tabellen werden
+ * nur einmal (für alle Schlüssel bemessen) angelegt; die Ergebnisse werden
+ * mit Laufzeit pro Schlüssel ausgegeben, sobald sie vorliegen.
+ *
+ * RETURN-Code: Anzahl der Schlüssel, deren Logarithmus nicht stimmt.
+ */
+static int dlog_batch(const char *keyfile)
+{
+	DlogContext ctx;
+	PublicData *keys;
+	int i, nkeys, ok, bad = 0;
+	double t0;
+	mpz_t x, check;
 
-	for (i = 0; i < nfactors; i++) {
-		mpz_div(p, prod, factorlist[i]);
-		mpz_invert(p_inv, p, factorlist[i]);
-		mpz_mul(tmp, p_inv, p);
-		mpz_mul(tmp, crt_x_is[i], tmp);
-		mpz_add(sum, sum, tmp);
+	if (!(nkeys = Get_All_Public_Keys(keyfile, &keys)))
+		return 1;
+	if (bsgs_targets < (unsigned long)nkeys)
+		bsgs_targets = nkeys;                // tables are shared by all keys
+
+	t0 = wall_clock();
+	dlog_init(&ctx);
+	printf("# %d keys, setup %.3f ms\n", nkeys, (wall_clock() - t0) * 1e3);
+	fflush(stdout);
+
+	mpz_inits(x, check, NULL);
+	for (i = 0; i < nkeys; i++) {
+		t0 = wall_clock();
+		ok = dlog_solve(&ctx, x, keys[i].y);
+		mpz_powm(check, w, x, p);
+		ok = ok && !mpz_cmp(check, keys[i].y);
+		bad += !ok;
+		gmp_printf("%-24s %Zx %.3f ms %s\n", keys[i].name, x, (wall_clock() - t0) * 1e3,
+				ok ? "ok" : "FAILED");
+		fflush(stdout);
 	}
-	mpz_mod(tmp, sum, prod);
-	mpz_set(x, tmp);
-	if (debug)
-		gmp_printf("sum=%Zd, prod=%Zd, x=%Zd.\n", sum, prod, tmp);
+	mpz_clears(x, check, NULL);
+	for (i = 0; i < nkeys; i++)
+		mpz_clear(keys[i].y);
+	free(keys);
+	dlog_clear(&ctx);
+	return bad;
 }
 
 
@@ -230,7 +779,11 @@ static void dlogP(mpz_t x, mpz_t y)
  * Verify_Sign(mdc,r,s,y) :
  *
  *  überprüft die El-Gamal-Signatur R/S zur MDC. Y ist der öffentliche
- *  Schlüssel des Absenders der Nachricht
+ *  Schlüssel des Absenders der Nachricht. Es muß 0 < r < p gelten, in einer
+ *  Schnorr-Gruppe (q != 0) außerdem 0 < s < q und y ^ q = 1 mod p. Nur dann
+ *  dürfen die Exponenten von y und w mod q reduziert werden. r braucht
+ *  keine Prüfung der Ordnung: r ^ s wird mit dem vollen r gerechnet, und r
+ *  steht sonst nur im Exponenten von y.
  *
  * RETURN-Code: 1, wenn Signatur OK, 0 sonst.
  */
@@ -239,60 +792,75 @@ static int Verify_Sign(mpz_t mdc, mpz_t r, mpz_t s, mpz_t y)
 	/*>>>>                                               <<<<*
 	 *>>>> AUFGABE: Verifizieren einer El-Gamal-Signatur <<<<*
 	 *>>>>                                               <<<<*/
-	if (debug)
-		gmp_printf("Verifying Signature for: \nm=%Zd, (r, s)=(%Zd, %Zd), pk=%Zd.\n", mdc, r, s, y);
-	
 	mpz_t a, b, c, d, e;
+	int ok = 0;
+	MPArenaMark mark;
+
+	if (mpz_sgn(r) <= 0 || mpz_cmp(r, p) >= 0 ||
+			(mpz_sgn(q) && (mpz_sgn(s) <= 0 || mpz_cmp(s, q) >= 0))) {
+		TRACE(TRACE_WARN, T_VERIFY, 0, TRACE_FP(r), TRACE_FP(s));
+		return 0;
+	}
+	mark = mp_arena_mark();
 
 	// a = y_A ^ r mod p
 	mpz_init(a);
-	mpz_powm(a, y, r, p);
-	if (debug)
-		gmp_printf("y_A^r mod p : %Zd ^ %Zd mod %Zd = %Zd.\n", y, r, p, a);
-
+	METRIC_START(t0);
+	if (mpz_sgn(q)) {
+		mpz_powm(a, y, q, p);         // y_A must lie in the subgroup of order q
+		if (mpz_cmp_ui(a, 1)) {
+			TRACE(TRACE_WARN, T_VERIFY, 0, TRACE_FP(y), TRACE_FP(q));
+			mpz_clear(a);
+			mp_arena_release(mark);
+			return 0;
+		}
+		mpz_mod(a, r, q);             // y_A ^ r = y_A ^ (r mod q)
+		mpz_powm(a, y, a, p);
+	} else
+		mpz_powm(a, y, r, p);
+	METRIC_STOP(M_VERIFY_POWM, t0, 1);
 
 	// b = r ^ s mod p
 	mpz_init(b);
+	METRIC_START(t1);
 	mpz_powm(b, r, s, p);
-	if (debug)
-		gmp_printf("r^s mod p : %Zd ^ %Zd mod %Zd = %Zd.\n", r, s, p, b);
+	METRIC_STOP(M_VERIFY_POWM, t1, 1);
 
 	// c = (y_A ^ r mod p) * (r ^ s mod p)
 	mpz_init(c);
 	mpz_mul(c, a, b);
-	if (debug) 
-		gmp_printf("a * b = c : %Zd * %Zd = %Zd.\nc mod p : %Zd mod", a, b, c, c);
 
 	// d = (y_A ^ r mod p) * (r ^ s mod p) mod p
 	mpz_init(d);
 	mpz_mod(d, c, p);
-	if (debug)
-		gmp_printf(" %Zd = %Zd.\n", p, d);
 
 	// e = w ^ m mod p
 	mpz_init(e);
-	mpz_powm(e, w, mdc, p);
-	if (debug)
-		gmp_printf("w^m mod p : %Zd ^ %Zd mod %Zd = %Zd.\n", w, mdc, p, e);
-
-	if (mpz_get_ui(d) == mpz_get_ui(e)) {
-		if (debug)
-			gmp_printf("m=%Zd and sign(r,s)=(%Zd,%Zd) verified.\n\n", mdc, r, s);
-		return 1;
-	}
-
-	if (debug)
-		gmp_printf("m=%Zd and sign(r,s)=(%Zd,%Zd) not verified.\n\n", mdc, r, s);
+	METRIC_START(t2);
+	if (mpz_sgn(q)) {
+		mpz_mod(e, mdc, q);
+		mpz_powm(e, w, e, p);
+	} else
+		mpz_powm(e, w, mdc, p);
+	METRIC_STOP(M_VERIFY_POWM, t2, 1);
+
+	if (mpz_cmp(d, e) == 0)
+		ok = 1;
+	TRACE(ok ? TRACE_DEBUG : TRACE_WARN, T_VERIFY, ok, TRACE_FP(d), TRACE_FP(e));
 
 	mpz_clears(a, b, c, d, e, NULL);
+	mp_arena_release(mark);
 		
-	return 0;
+	return ok;
 }
 
 
 /*
  * Generate_Sign(m,r,s,x) : Erzeugt zu der MDC M eine El-Gamal-Signatur 
- *    in R und S. X ist der private Schlüssel
+ *    in R und S. X ist der private Schlüssel. Die Exponenten k, x und s
+ *    leben mod n = p-1, in einer Schnorr-Gruppe mod n = q. k wird mit
+ *    Generate_Nonce() aus X und M abgeleitet, gleiche Eingaben liefern also
+ *    dieselbe Signatur.
  */
 static void Generate_Sign(mpz_t mdc, mpz_t r, mpz_t s, mpz_t x)
 {
@@ -300,70 +868,149 @@ static void Generate_Sign(mpz_t mdc, mpz_t r, mpz_t s, mpz_t x)
 	 *>>>> AUFGABE: Erzeugen einer El-Gamal-Signatur <<<<*
 	 *>>>>                                           <<<<*/
 
-	if (debug) {
-		gmp_printf("Generating Signature for: \np=%Zd, g=%Zd, m=%Zd, sk=%Zd.\n", p, w, mdc, x);
-	}
+	mpz_t k, n, k_1;
+	MPArenaMark mark;
 
-	mpz_t k, gcd, p_1, k_1;
-	gmp_randstate_t gmpRandState; 
+	mpz_realloc2(r, mpz_sizeinbase(p, 2) + GMP_NUMB_BITS);  // r and s outlive the arena scope
+	mpz_realloc2(s, mpz_sizeinbase(p, 2) + GMP_NUMB_BITS);
+	mark = mp_arena_mark();
 
-	mpz_init_set_ui(gcd, 0);
-	mpz_init(p_1);
-	mpz_sub_ui(p_1, p, 1);
+	mpz_init(n);                          // order of the exponents
+	if (mpz_sgn(q))
+		mpz_set(n, q);
+	else
+		mpz_sub_ui(n, p, 1);
 	mpz_init(k);
 	mpz_init(k_1);
 
-	// lets random some
-	gmp_randinit_default(gmpRandState);
-	gmp_randseed_ui(gmpRandState, time(NULL));
-	
-	// A zieht eine Zufallszahl k mit k < p-1 und ggT(k, p-1) = 1
-	while(mpz_get_ui(gcd) != 1) {
-		mpz_set_ui(gcd, 0);
-		mpz_urandomm(k, gmpRandState, p_1);
-		mpz_gcd(gcd, k, p_1);
-	}
-	if (debug)
-		gmp_printf("Found a k=%Zd\n", k);
+	// A leitet k mit 0 < k < n und ggT(k, n) = 1 deterministisch aus x und m ab
+	METRIC_START(t0);
+	int tries = Generate_Nonce(k, x, mdc, n);
+	METRIC_STOP(M_NONCE, t0, tries);
+	TRACE(TRACE_DEBUG, T_NONCE, tries, 0, 0);   // never trace k itself
 
 	// und berechnet r := w^k mod p
+	METRIC_START(t1);
 	mpz_powm(r, w, k, p);
-	if (debug)
-		gmp_printf("r = w^k mod p : r = %Zd ^ %Zd mod %Zd = %Zd.\n", w, k, p, r);
+	METRIC_STOP(M_SIGN_POWM, t1, 1);
 
-	// invert k mod (p-1) => k_1
-	mpz_invert(k_1, k, p_1);
-	if (debug)
-		gmp_printf("k * k^(-1) = 1 mod (p-1) : %Zd * %Zd = 1 mod %Zd.\n", k, k_1, p_1);
+	// invert k mod n => k_1
+	mpz_invert(k_1, k, n);
 
-	// und s := (m - r*x_A) * k^(-1) mod (p-1)
+	// und s := (m - r*x_A) * k^(-1) mod n
 	mpz_t tmp;
 	mpz_init(tmp);
 	mpz_mul(tmp, r, x);
-	mpz_sub(s, mdc, tmp);
-	mpz_mul(s, s, k_1);
-	mpz_mod(s, s, p_1);
+	mpz_sub(tmp, mdc, tmp);
+	mpz_mul(tmp, tmp, k_1);
+	mpz_mod(s, tmp, n);
+	TRACE(TRACE_DEBUG, T_SIGN, TRACE_FP(mdc), TRACE_FP(r), TRACE_FP(s));
 
-	if (debug)
-		gmp_printf("s = (m - r*sk) * k^(-1) mod (p-1) : s = (%Zd - %Zd*%Zd) * %Zd mod (%Zd) = %Zd.\n", mdc, r, x, k_1, p_1, s);
+	mpz_clears(k, n, k_1, tmp, NULL);
+	mp_arena_release(mark);
 
-	if (debug)
-		gmp_printf("r=%Zd, s=%Zd.\n\n", r, s);
 
-	mpz_clears(k, gcd, p_1, k_1, tmp, NULL);
-	gmp_randclear(gmpRandState);
+}
+
+/*
+ * sign_bench(set, rounds) :
+ *
+ * Misst für jeden eingebauten Parametersatz (oder nur für SET) den Durchsatz
+ * von Generate_Sign() und Verify_Sign() über ROUNDS Signaturen mit einem
+ * zufälligen Schlüssel. p, w und q werden dabei überschrieben.
+ *
+ * Zum Schluß wird geprüft, daß eine veränderte Signatur abgelehnt wird.
+ *
+ * RETURN-Code: Anzahl der falsch beurteilten Signaturen.
+ */
+static int sign_bench(const char *set, int rounds)
+{
+	const ParamSet *ps;
+	gmp_randstate_t st;
+	mpz_t x, y, mdc, r, s, n;
+	double t0, t_sign, t_verify;
+	int i, bad = 0;
+
+	if (rounds < 1)
+		rounds = 1;
+	gmp_randinit_default(st);
+	mpz_inits(x, y, mdc, r, s, n, NULL);
+	printf("# %-11s %5s %5s %10s %10s %10s %10s\n", "set", "bits", "exp", "sign/s", "verify/s", "sign_ms", "verify_ms");
+	for (ps = param_sets; ps->name; ps++) {
+		if (set && strcmp(set, ps->name) && atoi(set) != ps->bits)
+			continue;
+		Get_Param_Set(ps->name, p, w, q);
+		if (mpz_sgn(q))                  // secret keys live mod q or mod p-1
+			mpz_set(n, q);
+		else
+			mpz_sub_ui(n, p, 1);
+		mpz_urandomm(x, st, n);
+		mpz_powm(y, w, x, p);
+		t_sign = t_verify = 0;
+		for (i = 0; i < rounds; i++) {
+			mpz_urandomm(mdc, st, p);
+			t0 = wall_clock();
+			Generate_Sign(mdc, r, s, x);
+			t_sign += wall_clock() - t0;
+			t0 = wall_clock();
+			bad += !Verify_Sign(mdc, r, s, y);
+			t_verify += wall_clock() - t0;
+		}
+		// the last signature must not pass for another MDC, for r + p or,
+		// in a Schnorr group, for -y which is not of order q
+		mpz_add_ui(mdc, mdc, 1);
+		bad += Verify_Sign(mdc, r, s, y);
+		mpz_sub_ui(mdc, mdc, 1);
+		mpz_add(r, r, p);
+		bad += Verify_Sign(mdc, r, s, y);
+		mpz_sub(r, r, p);
+		if (mpz_sgn(q)) {
+			mpz_sub(y, p, y);
+			bad += Verify_Sign(mdc, r, s, y);
+		}
+		printf("  %-11s %5lu %5lu %10.1f %10.1f %10.3f %10.3f\n", ps->name,
+				(unsigned long)mpz_sizeinbase(p, 2), (unsigned long)mpz_sizeinbase(n, 2),
+				rounds / t_sign, rounds / t_verify, t_sign * 1e3 / rounds, t_verify * 1e3 / rounds);
+		fflush(stdout);
+	}
+	mpz_clears(x, y, mdc, r, s, n, NULL);
+	gmp_randclear(st);
+	return bad;
+}
 
+static int self_test(void);
 
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-d] [-n every] [-m babysteps] [-M budget_kib] [-T targets] [-A] [-V lanes] [-S prom|json] [-B keyfile] [-b rounds [-P set]] [-t]\n"
+			"  -d             print trace events live (-dd: also single steps)\n"
+			"  -n every       record every n-th BSGS step in the trace ring\n"
+			"  -m babysteps   fixed number of baby steps per BSGS table\n"
+			"  -M budget_kib  memory cap per BSGS table in KiB\n"
+			"  -T targets     expected number of targets per BSGS table\n"
+			"  -A             measure insert/giant-step cost and tune m\n"
+			"  -V lanes       run the giant steps of all factors on the vector engine\n"
+			"  -S format      print a metrics snapshot (prom or json) on exit\n"
+			"  -B keyfile     audit: recover the secret keys of all public keys in keyfile\n"
+			"  -b rounds      benchmark sign/verify for the built-in parameter sets\n"
+			"  -P set         with -b: only this parameter set (modp1024 ... modp4096, schnorr1024 ...\n"
+			"                 schnorr3072, or bits)\n"
+			"  -t             run the built-in self tests\n", prog);
+	exit(1);
 }
 
 int main(int argc, char **argv)
 {
 	Connection con;
-	int cnt,ok;
+	int cnt,ok,opt;
 	Message msg;
 	mpz_t x, Daemon_y, Daemon_x, mdc, sign_s, sign_r, fake_x;
 	char *OurName = "manton";
 	char* fake_report[10];
+	const char *metrics_format = NULL;
+	const char *batch_file = NULL;
+	const char *param_set = NULL;
+	int bench_rounds = 0;
 
 	mpz_init(x);
 	mpz_init(Daemon_y);
@@ -373,10 +1020,59 @@ int main(int argc, char **argv)
 	mpz_init(sign_r);
 	mpz_init(p);
 	mpz_init(w);
+	mpz_init(q);
 	mpz_init(fake_x);
 
+	while ((opt = getopt(argc, argv, "dn:m:M:T:AV:S:B:b:P:t")) != -1) {
+		switch (opt) {
+			case 'd': trace_live = trace_live < TRACE_DEBUG ? TRACE_DEBUG : TRACE_STEP; break;
+			case 'n': trace_sample = strtoul(optarg, NULL, 0); trace_level = TRACE_STEP; break;
+			case 'm': bsgs_m = strtoul(optarg, NULL, 0); break;
+			case 'M': bsgs_mem_budget = strtoul(optarg, NULL, 0) * 1024; break;
+			case 'T': bsgs_targets = strtoul(optarg, NULL, 0); break;
+			case 'A': bsgs_autotune = 1; break;
+			case 'V': bsgs_engine = atoi(optarg); break;
+			case 'S': metrics_format = optarg; break;
+			case 'B': batch_file = optarg; break;
+			case 'b': bench_rounds = atoi(optarg); break;
+			case 'P': param_set = optarg; break;
+			case 't': return self_test();
+			default : usage(argv[0]);
+		}
+	}
+	if (!trace_sample)
+		trace_sample = 1;
+	if (trace_level < trace_live)
+		trace_level = trace_live;
+	if (param_set && !bench_rounds)      // -P only selects the benchmark sets
+		usage(argv[0]);
+	if (param_set && !Get_Param_Set(param_set, p, w, q))
+		exit(20);
+
+	/*************  Benchmark: Signieren und Prüfen pro Bitlänge  *************/
+	if (bench_rounds) {
+		ok = sign_bench(param_set, bench_rounds);
+		if (metrics_format && !metrics_dump(stdout, metrics_format))
+			fprintf(stderr, "Unbekanntes Metrik-Format: %s\n", metrics_format);
+		return ok ? 1 : 0;
+	}
+
+	/**************  Audit-Modus: alle öffentlichen Schlüssel  ****************/
+	if (batch_file) {
+		if (!Get_Private_Key(NULL, p, w, x, q)) exit(0);
+		ok = dlog_batch(batch_file);
+		if (metrics_format && !metrics_dump(stdout, metrics_format))
+			fprintf(stderr, "Unbekanntes Metrik-Format: %s\n", metrics_format);
+		return ok ? 1 : 0;
+	}
+
 	/**************  Laden der öffentlichen und privaten Daten  ***************/
-	if (!Get_Private_Key(NULL, p, w, x) || !Get_Public_Key(DAEMON_NAME, Daemon_y)) exit(0);
+	if (!Get_Private_Key(NULL, p, w, x, q) || !Get_Public_Key(DAEMON_NAME, Daemon_y)) exit(0);
+	if (mpz_sizeinbase(p, 16) + 1 > STRINGLEN) {     /* r, s < p müssen in sign_r/sign_s passen */
+		fprintf(stderr,"Modulus mit %lu Bit paßt nicht in die Nachricht (STRINGLEN %d)\n",
+				(unsigned long)mpz_sizeinbase(p, 2),STRINGLEN);
+		exit(20);
+	}
 
 
 	/********************  Verbindung zum Dämon aufbauen  *********************/
@@ -391,8 +1087,8 @@ int main(int argc, char **argv)
 	strcpy(msg.body.ReportRequest.Name,OurName);    /* Gruppennamen eintragen */
 	Generate_MDC(&msg, p, mdc);                     /* MDC generieren ... */
 	Generate_Sign(mdc, sign_r, sign_s, x);          /* ... und Nachricht unterschreiben */
-	strcpy(msg.sign_r, mpz_get_str(NULL, 16, sign_r));
-	strcpy(msg.sign_s, mpz_get_str(NULL, 16, sign_s));
+	mpz_get_str(msg.sign_r, 16, sign_r);
+	mpz_get_str(msg.sign_s, 16, sign_s);
 
 	/*************  Machricht abschicken, Antwort einlesen  *******************/
 	if (Transmit(con,&msg,sizeof(msg))!=sizeof(msg)) {
@@ -417,7 +1113,10 @@ int main(int argc, char **argv)
 	mpz_set_str(sign_s, msg.sign_s, 16);
 	ok=Verify_Sign(mdc, sign_r, sign_s, Daemon_y);
 	if (ok) printf("Dämon-Signatur ist ok!\n");
-	else printf("Dämon-Signatur ist FEHLERHAFT!\n");
+	else {
+		printf("Dämon-Signatur ist FEHLERHAFT!\n");
+		trace_dump(stderr);
+	}
 
 	/*>>>>                                      <<<<*
 	 *>>>> AUFGABE: Fälschen der Dämon-Signatur <<<<*
@@ -444,8 +1143,8 @@ int main(int argc, char **argv)
 	strcpy(msg.body.VerifyRequest.Report[2],"zahl erreicht. Ein Schein wird daher gewährt."); /* Nachricht eintragen */
 	Generate_MDC(&msg, p, mdc);                     /* MDC generieren ... */
 	Generate_Sign(mdc, sign_r, sign_s, fake_x);          /* ... und Nachricht unterschreiben */
-	strcpy(msg.sign_r, mpz_get_str(NULL, 16, sign_r));
-	strcpy(msg.sign_s, mpz_get_str(NULL, 16, sign_s));
+	mpz_get_str(msg.sign_r, 16, sign_r);
+	mpz_get_str(msg.sign_s, 16, sign_s);
 
 	/*************  Machricht abschicken, Antwort einlesen  *******************/
 	if (Transmit(con,&msg,sizeof(msg))!=sizeof(msg)) {
@@ -466,6 +1165,9 @@ int main(int argc, char **argv)
 
 	mpz_clears(x, Daemon_y, Daemon_x, mdc, sign_s, sign_r, p, w, NULL);
 
+	if (metrics_format && !metrics_dump(stdout, metrics_format))
+		fprintf(stderr, "Unbekanntes Metrik-Format: %s\n", metrics_format);
+
 	return 0;
 }
 
@@ -550,3 +1252,260 @@ int main2(int argc, char **argv)
 
 	return 0;
 }
+
+
+/*
+ * selftest_gstep() : Vergleicht die Kerne der Vektor-Engine (skalar und,
+ *   falls vorhanden, IFMA) für Moduln von 17 bis 4096 Bit mit mpz_mul/mpz_mod.
+ *
+ * RETURN-Code: Anzahl der Abweichungen.
+ */
+static int selftest_gstep(void)
+{
+	static const int sizes[] = { 17, 51, 52, 64, 103, 512, 1024, 2048, 3072, 4096, 0 };
+	const int lanes = 16, steps = 200;
+	gmp_randstate_t st;
+	GSBatch b;
+	mpz_t mod, val[16], mult[16], tmp;
+	int i, k, n, ifma, bad, total = 0;
+
+	gmp_randinit_default(st);
+	gmp_randseed_ui(st, 7);
+	mpz_inits(mod, tmp, NULL);
+	for (k = 0; k < lanes; k++)
+		mpz_inits(val[k], mult[k], NULL);
+	for (i = 0; sizes[i]; i++) {
+		mpz_urandomb(mod, st, sizes[i]);
+		mpz_setbit(mod, sizes[i] - 1);
+		mpz_setbit(mod, 0);                 // Montgomery needs an odd modulus
+		for (ifma = 0; ifma < 2; ifma++) {
+			gs_init(&b, mod, lanes);
+			if (ifma && !b.ifma) {
+				printf("  gstep %4d bit ifma  skipped (no AVX-512 IFMA)\n", sizes[i]);
+				gs_clear(&b);
+				continue;
+			}
+			b.ifma = ifma;
+			for (k = 0; k < lanes; k++) {
+				mpz_urandomm(val[k], st, mod);
+				mpz_urandomm(mult[k], st, mod);
+				gs_set(&b, k, val[k], mult[k]);
+			}
+			for (n = 0, bad = 0; n < steps; n++) {
+				gs_step(&b);
+				for (k = 0; k < lanes; k++) {
+					mpz_mul(val[k], val[k], mult[k]);
+					mpz_mod(val[k], val[k], mod);
+					gs_get(&b, k, tmp);
+					bad += mpz_cmp(tmp, val[k]) != 0 || gs_fp(&b, k) != TRACE_FP(val[k]);
+				}
+			}
+			printf("  gstep %4d bit %-6s %s\n", sizes[i], ifma ? "ifma" : "scalar", bad ? "FAILED" : "ok");
+			total += bad;
+			gs_clear(&b);
+		}
+	}
+	for (k = 0; k < lanes; k++)
+		mpz_clears(val[k], mult[k], NULL);
+	mpz_clears(mod, tmp, NULL);
+	gmp_randclear(st);
+	return total;
+}
+
+/*
+ * selftest_bsgs() : Baut in einer kleinen Gruppe mod p Tabellen aller Kerne
+ *   (Untergruppen mit 16, 41 und 71 Bit) mit festem m, unter einem
+ *   Speicherbudget und mit Autotuning, jeweils ohne und mit Vektor-Engine,
+ *   und sucht darin bekannte Logarithmen.
+ *
+ * RETURN-Code: Anzahl der Abweichungen.
+ */
+static int selftest_bsgs(void)
+{
+	static const struct {
+		unsigned long m, budget;           /* wie -m und -M, budget in Bytes */
+		int autotune, engine;
+		BSGSKind kind[3];                  /* erwarteter Kern je Untergruppe */
+	} cfg[] = {
+		{ 1000, 0,     0, 0, { BSGS_FULL, BSGS_FP64, BSGS_GENERIC } },
+		{ 1000, 0,     0, 8, { BSGS_FULL, BSGS_FP64, BSGS_GENERIC } },
+		{ 0,    65536, 1, 0, { BSGS_FP64, BSGS_FP64, BSGS_GENERIC } },
+		{ 0,    65536, 1, 8, { BSGS_FP64, BSGS_FP64, BSGS_GENERIC } },
+		{ 0,    1,     0, 8, { BSGS_FP64, BSGS_FP64, BSGS_GENERIC } },
+	};
+	static const int qbits[3] = { 16, 40, 70 };
+	const unsigned long save_m = bsgs_m, save_budget = bsgs_mem_budget;
+	const int save_autotune = bsgs_autotune, save_engine = bsgs_engine;
+	const int nx = 7;
+	gmp_randstate_t st;
+	BSGSTable t;
+	GSWalk walks[7];
+	mpz_t save_p, save_w, q_i[3], e_i, w_i, x[7], x_i[7], tmp;
+	unsigned long m;
+	int c, i, k, bad, total = 0;
+
+	gmp_randinit_default(st);
+	gmp_randseed_ui(st, 11);
+	mpz_init_set(save_p, p);
+	mpz_init_set(save_w, w);
+	mpz_inits(e_i, w_i, tmp, NULL);
+	for (k = 0; k < nx; k++) {
+		mpz_inits(x[k], x_i[k], walks[k].a_i, NULL);
+		walks[k].t = &t;
+		walks[k].x_i = x_i[k];
+	}
+
+	// p = 2 * c * q_0 * q_1 * q_2 + 1 with q_0 = 65521 < 2^16, q_1 ~ 2^40 and q_2 ~ 2^70
+	for (i = 0; i < 3; i++) {
+		mpz_init_set_ui(q_i[i], 0);
+		mpz_setbit(q_i[i], qbits[i]);
+		if (i == 0)
+			mpz_set_ui(q_i[i], 65521);
+		else
+			mpz_nextprime(q_i[i], q_i[i]);
+	}
+	mpz_mul(tmp, q_i[0], q_i[1]);
+	mpz_mul(tmp, tmp, q_i[2]);
+	mpz_mul_2exp(tmp, tmp, 1);
+	for (mpz_add_ui(p, tmp, 1); !mpz_probab_prime_p(p, 25); mpz_add(p, p, tmp));
+	mpz_set_ui(w, 3);
+
+	for (c = 0; c < (int)(sizeof(cfg) / sizeof(cfg[0])); c++) {
+		bsgs_m = cfg[c].m;
+		bsgs_mem_budget = cfg[c].budget;
+		bsgs_autotune = cfg[c].autotune;
+		bsgs_engine = cfg[c].engine;
+		bsgs_tuned[0] = bsgs_tuned[1] = bsgs_tuned[2] = 0;
+		for (i = 0; i < 3; i++) {
+			// w_i = g^((p-1)/q_i) != 1 generates the subgroup of order q_i
+			mpz_sub_ui(e_i, p, 1);
+			mpz_divexact(e_i, e_i, q_i[i]);
+			mpz_set_ui(tmp, 1);
+			do {
+				mpz_add_ui(tmp, tmp, 1);
+				mpz_powm(w_i, tmp, e_i, p);
+			} while (!mpz_cmp_ui(w_i, 1));
+
+			m = bsgs_choose_m(q_i[i], 1);
+			bsgs_table_init(&t, w_i, q_i[i], m);
+			if (bsgs_engine)
+				bsgs_table_index(&t);
+			m = t.m;
+
+			// logarithms at the table edges and a few giant steps further out
+			mpz_set_ui(x[0], 0);
+			mpz_set_ui(x[1], 1);
+			mpz_set_ui(x[2], m - 1);
+			mpz_set_ui(x[3], m);
+			mpz_set_ui(x[4], 3 * m + 7);
+			mpz_urandomm(x[5], st, q_i[i]);
+			mpz_tdiv_r_ui(x[5], x[5], 40 * m);
+			mpz_sub_ui(x[6], q_i[i], 1);
+			if (t.steps > 64)            // q_i - 1 only where the walk is short
+				mpz_set_ui(x[6], 2 * m + 1);
+			for (k = 0; k < nx; k++) {
+				mpz_mod(x[k], x[k], q_i[i]);
+				mpz_powm(walks[k].a_i, w_i, x[k], p);
+				mpz_set_ui(x_i[k], 0);
+				walks[k].next = 0;
+				walks[k].solved = 0;
+			}
+
+			bad = t.kind != cfg[c].kind[i];
+			if (bsgs_engine)
+				bad += bsgs_solve_walks(walks, nx) != nx;
+			else
+				for (k = 0; k < nx; k++)
+					bad += !bsgs_table_solve(&t, x_i[k], walks[k].a_i);
+			for (k = 0; k < nx; k++) {
+				mpz_mod(tmp, x_i[k], q_i[i]);
+				bad += mpz_cmp(tmp, x[k]) != 0;
+			}
+			printf("  bsgs  %4lu bit %-7s m %-6lu%s%s %s\n", (unsigned long)mpz_sizeinbase(q_i[i], 2),
+					t.kind == BSGS_FULL ? "full" : t.kind == BSGS_FP64 ? "fp64" : "generic", m,
+					cfg[c].budget ? " budget" : "", bsgs_engine ? " engine" : "", bad ? "FAILED" : "ok");
+			if (bad)
+				trace_dump(stderr);
+			total += bad;
+			bsgs_table_clear(&t);
+		}
+	}
+
+	bsgs_m = save_m;
+	bsgs_mem_budget = save_budget;
+	bsgs_autotune = save_autotune;
+	bsgs_engine = save_engine;
+	bsgs_tuned[0] = bsgs_tuned[1] = bsgs_tuned[2] = 0;
+	mpz_swap(p, save_p);
+	mpz_swap(w, save_w);
+	for (i = 0; i < 3; i++)
+		mpz_clear(q_i[i]);
+	for (k = 0; k < nx; k++)
+		mpz_clears(x[k], x_i[k], walks[k].a_i, NULL);
+	mpz_clears(save_p, save_w, e_i, w_i, tmp, NULL);
+	gmp_randclear(st);
+	return total;
+}
+
+/*
+ * selftest_nonce() : Prüft Generate_Nonce() gegen feste Werte (n, x, mdc) ->
+ *   (Kandidaten, k), berechnet mit einer unabhängigen Implementierung von
+ *   HMAC_DRBG (RFC 6979, 3.2) mit HMAC-MD5.
+ *
+ * RETURN-Code: Anzahl der Abweichungen.
+ */
+static int selftest_nonce(void)
+{
+	static const struct {
+		const char *n, *x, *mdc;
+		int tries;
+		const char *k;
+	} vec[] = {
+		{ "F3C68DAD0EBF3115BD89E3A22CE330FEA16A127D27E1343E1D076C3E6D8A3910"      /* p-1 des Versuchs */
+		  "BB0B19D7A953E1136E897CB6310187600F0A50C3398EB5240567EEA87B053F40",
+		  "1234567", "ABCDEF", 25,
+		  "C91509FFA2E98EF66FA2F8C788D084EB2C30481026AD8478CB7270106C0A32D0"
+		  "C52BB10AD14B5D5E701925D6C8564BD7E634FFEB93C22F2BC8F3D6039C985D85" },
+		{ "CA3E5D4ED98C294BF9375148E3C00CD606199223",                              /* q von schnorr1024 */
+		  "DEADBEEF", "42", 2,
+		  "A924BBC9FF5E1D27C2CCCACA8139234E7E0FE67F" },
+		{ "F3FEA83CB0799667B8F1799CAE54412EDB64637CAE3586583C364C675345ADC9",      /* q von schnorr2048, */
+		  "2B85433C91AF7921692EF71435894B14A4434286F9E09132C1CE47F6356EF132B329",   /* x = 3^170 > q, */
+		  "1AA3B2C5319D5E494C9A977611D99B7B5CB34B967D4A2C6AECEF68933BE1FC93D3A1A61", /* mdc = 7^100 > q */
+		  2, "AEDD706E143C15101DFEFBC91A3853AB9E74BC3D476F0256B9D090A6D8374340" },
+		{ "C", "1", "2", 5, "5" },
+		{ "3C", "5", "7", 2, "7" },
+	};
+	mpz_t n, x, mdc, k, ref;
+	int i, tries, bad, total = 0;
+
+	mpz_inits(n, x, mdc, k, ref, NULL);
+	for (i = 0; i < (int)(sizeof(vec) / sizeof(vec[0])); i++) {
+		mpz_set_str(n, vec[i].n, 16);
+		mpz_set_str(x, vec[i].x, 16);
+		mpz_set_str(mdc, vec[i].mdc, 16);
+		mpz_set_str(ref, vec[i].k, 16);
+		tries = Generate_Nonce(k, x, mdc, n);
+		bad = tries != vec[i].tries || mpz_cmp(k, ref);
+		printf("  nonce %4lu bit vector %d %s\n", (unsigned long)mpz_sizeinbase(n, 2), i, bad ? "FAILED" : "ok");
+		total += bad;
+	}
+	mpz_clears(n, x, mdc, k, ref, NULL);
+	return total;
+}
+
+/*
+ * self_test() : Selbsttest der Teile, die sonst nur indirekt laufen.
+ *
+ * RETURN-Code: 0, wenn alles stimmt, 1 sonst.
+ */
+static int self_test(void)
+{
+	int bad = 0;
+
+	bad += selftest_gstep();
+	bad += selftest_bsgs();
+	bad += selftest_nonce();
+	printf("self test %s\n", bad ? "FAILED" : "ok");
+	return bad ? 1 : 0;
+}
@@ -0,0 +1,267 @@
+/*************************************************************
+**         Europäisches Institut für Systemsicherheit        *
+**   Proktikum "Kryptographie und Datensicherheitstechnik"   *
+**                                                           *
+** Versuch 7: El-Gamal-Signatur                              *
+**                                                           *
+**************************************************************
+**
+** gstep.c: Vektor-Engine für parallele Giant-Step-Läufe
+**
+** K unabhängige Läufe T_k <- T_k * M_k mod p werden gemeinsam
+** weitergeschaltet. Die Zahlen liegen in 52-Bit-Limbs als Structure of
+** Arrays vor (Limb j von Lauf k in t[j*K + k]), so daß eine Montgomery-
+** Multiplikation für 8 Läufe mit AVX-512 IFMA (vpmadd52luq/vpmadd52huq)
+** auf einmal läuft. Ohne IFMA rechnet der skalare Kern denselben
+** Algorithmus Lauf für Lauf.
+**
+** Die Läufe selbst bleiben in der normalen Darstellung: nur die
+** Multiplikatoren werden in Montgomery-Form M_k * R abgelegt, damit ist
+** MontMul(T_k, M_k * R) = T_k * M_k mod p, voll reduziert.
+**/
+
+#include "sign.h"
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define GS_HAVE_IFMA 1
+#endif
+
+#define GS_BITS  52
+#define GS_MASK  ((1ULL << GS_BITS) - 1)
+#define GS_VEC   8                   /* Läufe pro 512-Bit-Register */
+
+typedef unsigned __int128 u128;
+
+/* Zerlegt Z (0 <= Z < 2^(52*L)) in L Limbs, Abstand STRIDE */
+static void gs_from_mpz(uint64_t *dst, int stride, int L, mpz_t z)
+{
+	uint64_t words[GS_MAXL + 1];
+	size_t n = 0;
+	int j, bit;
+
+	memset(words, 0, sizeof(words));
+	mpz_export(words, &n, -1, sizeof(uint64_t), 0, 0, z);
+	for (j = 0; j < L; j++) {
+		bit = j * GS_BITS;
+		uint64_t v = words[bit / 64] >> (bit % 64);
+		if (bit % 64 > 64 - GS_BITS)
+			v |= words[bit / 64 + 1] << (64 - bit % 64);
+		dst[j * stride] = v & GS_MASK;
+	}
+}
+
+static void gs_to_mpz(mpz_t z, const uint64_t *src, int stride, int L)
+{
+	uint64_t words[GS_MAXL + 1];
+	int j, bit;
+
+	memset(words, 0, sizeof(words));
+	for (j = 0; j < L; j++) {
+		bit = j * GS_BITS;
+		words[bit / 64] |= src[j * stride] << (bit % 64);
+		if (bit % 64 > 64 - GS_BITS)
+			words[bit / 64 + 1] |= src[j * stride] >> (64 - bit % 64);
+	}
+	mpz_import(z, (L * GS_BITS + 63) / 64, -1, sizeof(uint64_t), 0, 0, words);
+}
+
+/*
+ * gs_init(b, p, lanes) : Legt eine Engine für mindestens LANES Läufe mod P an.
+ *   Die Anzahl der Läufe wird auf ein Vielfaches von 8 aufgerundet.
+ */
+void gs_init(GSBatch *b, mpz_t p, int lanes)
+{
+	mpz_t tmp, r;
+	size_t bytes;
+
+	b->K = (lanes + GS_VEC - 1) / GS_VEC * GS_VEC;
+	if (b->K < GS_VEC) b->K = GS_VEC;
+	b->L = (mpz_sizeinbase(p, 2) + 1 + GS_BITS - 1) / GS_BITS;   // 2p < 2^(52L)
+	if (b->L < 2)                        // gs_fp() reads the two lowest limbs
+		b->L = 2;
+	if (b->L > GS_MAXL) {
+		fprintf(stderr,"GS_INIT: Modulus mit %lu Bit zu groß für die Vektor-Engine\n",
+				(unsigned long)mpz_sizeinbase(p, 2));
+		exit(20);
+	}
+	bytes = (size_t)b->L * b->K * sizeof(uint64_t);
+	b->t = aligned_alloc(64, bytes);
+	b->m = aligned_alloc(64, bytes);
+	memset(b->t, 0, bytes);
+	memset(b->m, 0, bytes);
+	gs_from_mpz(b->p, 1, b->L, p);
+
+	mpz_inits(tmp, r, NULL);
+	mpz_setbit(r, GS_BITS);
+	mpz_invert(tmp, p, r);               // k0 = -p^(-1) mod 2^52
+	mpz_sub(tmp, r, tmp);
+	b->k0 = mpz_get_ui(tmp) & GS_MASK;
+	mpz_init_set(b->mod, p);
+	mpz_init_set_ui(b->R, 0);
+	mpz_setbit(b->R, GS_BITS * b->L);    // R = 2^(52L) mod p
+	mpz_mod(b->R, b->R, p);
+	mpz_clears(tmp, r, NULL);
+
+#ifdef GS_HAVE_IFMA
+	b->ifma = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512ifma");
+#else
+	b->ifma = 0;
+#endif
+}
+
+void gs_clear(GSBatch *b)
+{
+	free(b->t);
+	free(b->m);
+	mpz_clears(b->mod, b->R, NULL);
+}
+
+/*
+ * gs_set(b, lane, value, mult) : Startet Lauf LANE bei VALUE (< p) mit
+ *   dem Faktor MULT pro Schritt.
+ */
+void gs_set(GSBatch *b, int lane, mpz_t value, mpz_t mult)
+{
+	mpz_t tmp;
+
+	mpz_init(tmp);
+	mpz_mul(tmp, mult, b->R);
+	mpz_mod(tmp, tmp, b->mod);
+	gs_from_mpz(b->m + lane, b->K, b->L, tmp);
+	gs_from_mpz(b->t + lane, b->K, b->L, value);
+	mpz_clear(tmp);
+}
+
+/*
+ * gs_get(b, lane, value) : Aktueller Wert von Lauf LANE.
+ */
+void gs_get(GSBatch *b, int lane, mpz_t value)
+{
+	gs_to_mpz(value, b->t + lane, b->K, b->L);
+}
+
+/*
+ * gs_fp(b, lane) : Unterste 64 Bit des aktuellen Wertes von Lauf LANE,
+ *   passend zu TRACE_FP() (unabhängig von der Limb-Größe von GMP).
+ */
+uint64_t gs_fp(GSBatch *b, int lane)
+{
+	return b->t[lane] | (b->t[b->K + lane] << GS_BITS);
+}
+
+/*
+ * Skalarer Kern: wortweise Montgomery-Multiplikation t <- t * m / R mod p
+ * für jeden Lauf. Die Teilprodukte werden wie bei IFMA in lo52/hi52 zerlegt
+ * und erst am Ende normalisiert.
+ */
+static void gs_step_scalar(GSBatch *b)
+{
+	const int K = b->K, L = b->L;
+	uint64_t z[GS_MAXL + 1], hi[GS_MAXL], d[GS_MAXL];
+	uint64_t q, c, borrow, keep;
+	u128 pr;
+	int i, j, k;
+
+	for (k = 0; k < K; k++) {
+		memset(z, 0, sizeof(z));
+		for (i = 0; i < L; i++) {
+			uint64_t ai = b->t[i * K + k];
+			for (j = 0; j < L; j++) {
+				pr = (u128)ai * b->m[j * K + k];
+				z[j] += (uint64_t)pr & GS_MASK;
+				hi[j] = (uint64_t)(pr >> GS_BITS);
+			}
+			q = (z[0] * b->k0) & GS_MASK;
+			for (j = 0; j < L; j++) {
+				pr = (u128)q * b->p[j];
+				z[j] += (uint64_t)pr & GS_MASK;
+				hi[j] += (uint64_t)(pr >> GS_BITS);
+			}
+			c = z[0] >> GS_BITS;      // z[0] is now 0 mod 2^52: shift down one limb
+			for (j = 0; j < L - 1; j++)
+				z[j] = z[j + 1] + hi[j];
+			z[L - 1] = hi[L - 1];
+			z[0] += c;
+		}
+		for (j = 0; j < L - 1; j++) {
+			z[j + 1] += z[j] >> GS_BITS;
+			z[j] &= GS_MASK;
+		}
+		// z < 2p: subtract p once if that does not borrow
+		for (j = 0, borrow = 0; j < L; j++) {
+			d[j] = z[j] - b->p[j] - borrow;
+			borrow = d[j] >> 63;
+			d[j] &= GS_MASK;
+		}
+		keep = -borrow;               // all ones: keep z, zero: take z - p
+		for (j = 0; j < L; j++)
+			b->t[j * K + k] = (z[j] & keep) | (d[j] & ~keep);
+	}
+}
+
+#ifdef GS_HAVE_IFMA
+/*
+ * IFMA-Kern: derselbe Algorithmus wie gs_step_scalar(), 8 Läufe pro Register.
+ */
+__attribute__((target("avx512f,avx512ifma")))
+static void gs_step_ifma(GSBatch *b)
+{
+	const int K = b->K, L = b->L;
+	const __m512i mask = _mm512_set1_epi64(GS_MASK), zero = _mm512_setzero_si512();
+	const __m512i k0 = _mm512_set1_epi64(b->k0);
+	__m512i z[GS_MAXL], hi[GS_MAXL], d[GS_MAXL], ai, pj, q, c, borrow;
+	__mmask8 take;
+	int i, j, k;
+
+	for (k = 0; k < K; k += GS_VEC) {
+		for (j = 0; j < L; j++)
+			z[j] = zero;
+		for (i = 0; i < L; i++) {
+			ai = _mm512_load_si512((const void *)(b->t + i * K + k));
+			for (j = 0; j < L; j++) {
+				__m512i mj = _mm512_load_si512((const void *)(b->m + j * K + k));
+				z[j] = _mm512_madd52lo_epu64(z[j], ai, mj);
+				hi[j] = _mm512_madd52hi_epu64(zero, ai, mj);
+			}
+			q = _mm512_madd52lo_epu64(zero, z[0], k0);
+			for (j = 0; j < L; j++) {
+				pj = _mm512_set1_epi64(b->p[j]);
+				z[j] = _mm512_madd52lo_epu64(z[j], q, pj);
+				hi[j] = _mm512_madd52hi_epu64(hi[j], q, pj);
+			}
+			c = _mm512_srli_epi64(z[0], GS_BITS);
+			for (j = 0; j < L - 1; j++)
+				z[j] = _mm512_add_epi64(z[j + 1], hi[j]);
+			z[L - 1] = hi[L - 1];
+			z[0] = _mm512_add_epi64(z[0], c);
+		}
+		for (j = 0; j < L - 1; j++) {
+			z[j + 1] = _mm512_add_epi64(z[j + 1], _mm512_srli_epi64(z[j], GS_BITS));
+			z[j] = _mm512_and_si512(z[j], mask);
+		}
+		borrow = zero;
+		for (j = 0; j < L; j++) {
+			d[j] = _mm512_sub_epi64(_mm512_sub_epi64(z[j], _mm512_set1_epi64(b->p[j])), borrow);
+			borrow = _mm512_srli_epi64(d[j], 63);
+			d[j] = _mm512_and_si512(d[j], mask);
+		}
+		take = _mm512_cmpeq_epi64_mask(borrow, zero);
+		for (j = 0; j < L; j++)
+			_mm512_store_si512((void *)(b->t + j * K + k), _mm512_mask_blend_epi64(take, z[j], d[j]));
+	}
+}
+#endif
+
+/*
+ * gs_step(b) : Ein Giant-Step für alle Läufe: T_k <- T_k * M_k mod p.
+ */
+void gs_step(GSBatch *b)
+{
+#ifdef GS_HAVE_IFMA
+	if (b->ifma) {
+		gs_step_ifma(b);
+		return;
+	}
+#endif
+	gs_step_scalar(b);
+}
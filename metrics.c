@@ -0,0 +1,137 @@
+/*************************************************************
+**         Europäisches Institut für Systemsicherheit        *
+**   Proktikum "Kryptographie und Datensicherheitstechnik"   *
+**                                                           *
+** Versuch 7: El-Gamal-Signatur                              *
+**                                                           *
+**************************************************************
+**
+** metrics.c: Zeitmessung und Zähler für die heißen Pfade
+**
+** Pro Phase (siehe MetricId in sign.h) werden Aufrufe, Zyklen, bearbeitete
+** Elemente und ein Histogramm der Zyklen pro Aufruf (Zweierpotenzen)
+** gesammelt. Die Makros METRIC_START/METRIC_STOP fallen ohne
+** -DMETRICS komplett weg. metrics_dump() schreibt einen Schnappschuß im
+** Prometheus-Textformat oder als JSON.
+**/
+
+#include "sign.h"
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define METRIC_BUCKETS 64
+
+typedef struct {
+	uint64_t calls;
+	uint64_t cycles;
+	uint64_t items;
+	uint64_t hist[METRIC_BUCKETS];   /* hist[b]: Aufrufe mit < 2^b Zyklen */
+} Metric;
+
+static Metric metrics[M_NUM];
+
+static const char *metric_names[M_NUM] = {
+	"mdc", "nonce", "sign_powm", "verify_powm",
+	"bsgs_baby", "bsgs_insert", "bsgs_giant", "crt"
+};
+
+/*
+ * metrics_cycles() : Zeitstempel in CPU-Zyklen (TSC), auf anderen
+ *   Architekturen in Nanosekunden.
+ */
+uint64_t metrics_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
+}
+
+/*
+ * metrics_record(id, cycles, items) : Verbucht einen Aufruf der Phase ID.
+ *   Die Zähler werden relaxed atomar erhöht, damit mehrere Threads
+ *   gleichzeitig messen können.
+ */
+void metrics_record(MetricId id, uint64_t cycles, uint64_t items)
+{
+	Metric *m = &metrics[id];
+	int b = cycles ? 64 - __builtin_clzll(cycles) : 0;
+
+	if (b >= METRIC_BUCKETS) b = METRIC_BUCKETS - 1;
+	__atomic_fetch_add(&m->calls, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&m->cycles, cycles, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&m->items, items, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&m->hist[b], 1, __ATOMIC_RELAXED);
+}
+
+static void dump_prometheus(FILE *f)
+{
+	int i, b, top;
+	uint64_t cum;
+
+	fprintf(f, "# HELP getreport_phase_cycles Cycles per call of a hot-path phase.\n");
+	fprintf(f, "# TYPE getreport_phase_cycles histogram\n");
+	for (i = 0; i < M_NUM; i++) {
+		const Metric *m = &metrics[i];
+		for (top = METRIC_BUCKETS - 1; top > 0 && !m->hist[top]; top--);
+		for (b = 0, cum = 0; b <= top; b++) {
+			cum += m->hist[b];
+			fprintf(f, "getreport_phase_cycles_bucket{phase=\"%s\",le=\"%llu\"} %llu\n",
+					metric_names[i], b < 63 ? (1ULL << b) - 1 : ~0ULL, (unsigned long long)cum);
+		}
+		fprintf(f, "getreport_phase_cycles_bucket{phase=\"%s\",le=\"+Inf\"} %llu\n",
+				metric_names[i], (unsigned long long)m->calls);
+		fprintf(f, "getreport_phase_cycles_sum{phase=\"%s\"} %llu\n",
+				metric_names[i], (unsigned long long)m->cycles);
+		fprintf(f, "getreport_phase_cycles_count{phase=\"%s\"} %llu\n",
+				metric_names[i], (unsigned long long)m->calls);
+	}
+	fprintf(f, "# HELP getreport_phase_items_total Elements processed per phase (steps, candidates, ...).\n");
+	fprintf(f, "# TYPE getreport_phase_items_total counter\n");
+	for (i = 0; i < M_NUM; i++)
+		fprintf(f, "getreport_phase_items_total{phase=\"%s\"} %llu\n",
+				metric_names[i], (unsigned long long)metrics[i].items);
+}
+
+static void dump_json(FILE *f)
+{
+	int i, b, first;
+
+	fprintf(f, "{");
+	for (i = 0; i < M_NUM; i++) {
+		const Metric *m = &metrics[i];
+		fprintf(f, "%s\n  \"%s\": {\"calls\": %llu, \"cycles\": %llu, \"items\": %llu, \"hist_log2\": {",
+				i ? "," : "", metric_names[i], (unsigned long long)m->calls,
+				(unsigned long long)m->cycles, (unsigned long long)m->items);
+		for (b = 0, first = 1; b < METRIC_BUCKETS; b++) {
+			if (!m->hist[b]) continue;
+			fprintf(f, "%s\"%d\": %llu", first ? "" : ", ", b, (unsigned long long)m->hist[b]);
+			first = 0;
+		}
+		fprintf(f, "}}");
+	}
+	fprintf(f, "\n}\n");
+}
+
+/*
+ * metrics_dump(f, format) : Schreibt einen Schnappschuß aller Phasen nach F.
+ *   FORMAT ist "prom" (Prometheus-Text) oder "json".
+ *
+ * RETURN-Code: 1 bei Erfolg, 0 bei unbekanntem Format.
+ */
+int metrics_dump(FILE *f, const char *format)
+{
+	if (!strcmp(format, "prom"))
+		dump_prometheus(f);
+	else if (!strcmp(format, "json"))
+		dump_json(f);
+	else
+		return 0;
+	fflush(f);
+	return 1;
+}
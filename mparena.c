@@ -0,0 +1,150 @@
+/*************************************************************
+**         Europäisches Institut für Systemsicherheit        *
+**   Proktikum "Kryptographie und Datensicherheitstechnik"   *
+**                                                           *
+** Versuch 7: El-Gamal-Signatur                              *
+**                                                           *
+**************************************************************
+**
+** mparena.c: Arena-Speicher für GMP-Temporäre
+**
+** Über mp_set_memory_functions() landen alle Allokationen von GMP, die
+** innerhalb eines Bereichs mp_arena_mark() ... mp_arena_release() passieren,
+** in einer Arena. mp_arena_release() gibt sie auf einen Schlag frei, die
+** Chunks bleiben für den nächsten Bereich erhalten. Außerhalb eines Bereichs
+** und für Zeiger, die nicht aus der Arena stammen, wird malloc/realloc/free
+** benutzt.
+**
+** ACHTUNG: Ein mpz_t, das einen Bereich überleben soll (Ergebnisse!), muß
+** vor mp_arena_mark() bereits groß genug sein (mpz_realloc2), sonst liegen
+** seine Limbs nach mp_arena_release() im freigegebenen Speicher.
+** Die Arena ist pro Thread; Zahlen aus einem Bereich dürfen den Thread nicht
+** verlassen.
+**/
+
+#include "sign.h"
+
+#define ARENA_MAXCHUNKS  32
+#define ARENA_MINCHUNK   (256 * 1024)
+#define ARENA_ALIGN      16
+
+typedef struct {
+	char *base;
+	size_t size;
+} ArenaChunk;
+
+static __thread ArenaChunk chunks[ARENA_MAXCHUNKS];
+static __thread int cur;           /* aktueller Chunk */
+static __thread size_t used;       /* belegte Bytes im aktuellen Chunk */
+static __thread void *last;        /* letzte Allokation, kann in-place wachsen */
+static __thread int depth;         /* Verschachtelungstiefe der Bereiche */
+static int installed;
+
+static void arena_oom(size_t size)
+{
+	fprintf(stderr,"MP_ARENA: Kein Speicher für %lu Bytes!\n",(unsigned long)size);
+	abort();
+}
+
+static int arena_owns(const void *ptr)
+{
+	int i;
+
+	for (i = 0; i < ARENA_MAXCHUNKS && chunks[i].base; i++)
+		if ((const char *)ptr >= chunks[i].base && (const char *)ptr < chunks[i].base + chunks[i].size)
+			return 1;
+	return 0;
+}
+
+void *mp_arena_alloc(size_t size)
+{
+	size_t n = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	size_t want;
+
+	if (!depth) {
+		void *ptr = malloc(size);
+		if (!ptr) arena_oom(size);
+		return ptr;
+	}
+	if (!chunks[cur].base || used + n > chunks[cur].size) {
+		if (chunks[cur].base) {     /* aktueller Chunk voll, weiter zum nächsten */
+			if (cur + 1 >= ARENA_MAXCHUNKS) arena_oom(size);
+			cur++;
+			used = 0;
+		}
+		if (!chunks[cur].base || chunks[cur].size < n) {
+			want = cur ? 2 * chunks[cur - 1].size : ARENA_MINCHUNK;
+			while (want < n) want *= 2;
+			free(chunks[cur].base);   /* vorhandener, aber zu kleiner Chunk */
+			if (!(chunks[cur].base = malloc(want))) arena_oom(want);
+			chunks[cur].size = want;
+		}
+	}
+	last = chunks[cur].base + used;
+	used += n;
+	return last;
+}
+
+static void *arena_realloc(void *ptr, size_t old_size, size_t new_size)
+{
+	void *res;
+
+	if (!arena_owns(ptr)) {
+		if (!(res = realloc(ptr, new_size))) arena_oom(new_size);
+		return res;
+	}
+	if (ptr == last && depth) {
+		size_t off = (char *)ptr - chunks[cur].base;
+		size_t n = (new_size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+		if (off + n <= chunks[cur].size) {
+			used = off + n;
+			return ptr;
+		}
+	}
+	res = mp_arena_alloc(new_size);
+	memcpy(res, ptr, old_size < new_size ? old_size : new_size);
+	return res;
+}
+
+static void arena_free(void *ptr, size_t size)
+{
+	if (!arena_owns(ptr)) {
+		free(ptr);
+		return;
+	}
+	if (ptr == last && depth) {   /* letzte Allokation zurücknehmen */
+		used = (char *)ptr - chunks[cur].base;
+		last = NULL;
+	}
+}
+
+/*
+ * mp_arena_mark() : Öffnet einen Arena-Bereich. Alle GMP-Allokationen bis
+ *   zum passenden mp_arena_release() kommen aus der Arena.
+ */
+MPArenaMark mp_arena_mark(void)
+{
+	MPArenaMark mark;
+
+	if (!installed) {
+		mp_set_memory_functions(mp_arena_alloc, arena_realloc, arena_free);
+		installed = 1;
+	}
+	mark.chunk = cur;
+	mark.used = used;
+	last = NULL;                  /* nichts von außerhalb in-place vergrößern */
+	depth++;
+	return mark;
+}
+
+/*
+ * mp_arena_release(mark) : Schließt den Bereich und gibt alles, was seit
+ *   mp_arena_mark() in der Arena angelegt wurde, auf einmal frei.
+ */
+void mp_arena_release(MPArenaMark mark)
+{
+	cur = mark.chunk;
+	used = mark.used;
+	last = NULL;
+	depth--;
+}
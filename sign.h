@@ -12,12 +12,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 
 #include <praktikum.h>
 #include <gmp.h>
 #include <network.h>
 
-#define nbits       512            /* Rechenlänge für diesen Versuch */
 #define LineLen      80            /* Länge einer String-Zeile in Zeichen */
 #define MaxLines     16            /* Maximale Anzahl von String-Zeilen in einer Nachricht */
 #define DAEMON_NAME  "Sign_Daemon" /* Name des Ports des Signatur-Dämons */
@@ -31,16 +31,59 @@ typedef struct {      /* personenbezogene Daten, eigentlich ist nur 'x' geheim!
 	mpz_t x;
 } SecretData;
 
+typedef struct {      /* eingebauter Parametersatz, siehe param_sets[] in signsupport.c */
+	const char *name;
+	int bits;
+	const char *p_hex;
+	const char *w_hex;
+	const char *q_hex;    /* Ordnung von w bei Schnorr-Gruppen, sonst NULL */
+} ParamSet;
+
 typedef struct {      /* Element for the Baby-Step Giant-Step algorithm */
 mpz_t w_i;
 unsigned long int index;
 } BSGSElement;
 
+typedef enum {        /* Kernel of a baby-step table, chosen by bsgs_kind() */
+BSGS_GENERIC,             /* sorted mpz list, bsearch */
+BSGS_FP64,                /* p_i < 2^64: only 64-bit fingerprints in a hash */
+BSGS_FULL                 /* p_i < 2^16: fingerprints of all w_i^j, no giant steps */
+} BSGSKind;
+
+typedef struct {      /* Baby-step table (w_i^j, j), 0 <= j < m, sorted by value */
+BSGSKind kind;
+BSGSElement *list;        /* BSGS_GENERIC only */
+unsigned long int m;      /* number of baby steps */
+unsigned long int steps;  /* number of giant steps, ceil(p_i / m) */
+mpz_t w_i;                /* generator of the subgroup, to check fingerprint hits */
+mpz_t inv_w_m;            /* giant-step factor (w_i^m)^(-1) mod p */
+uint64_t *fp_key;         /* hash on the lowest 64 bits, see bsgs_table_index() */
+unsigned long int *fp_pos;  /* list position (BSGS_GENERIC) or j (else) + 1 per slot, 0 = empty */
+unsigned long int fp_mask;
+} BSGSTable;
+
+typedef struct {      /* One giant-step walk for the vector engine (gstep.c) */
+BSGSTable *t;
+mpz_t a_i;                /* target */
+mpz_ptr x_i;              /* result, a_i = w_i ^ x_i mod p */
+unsigned long int next;   /* first giant step not yet handed to a lane */
+int solved;
+} GSWalk;
+
 typedef struct {      /* Öffentliche Daten einer Person */
 	String name;  /* Name des Inhabers */
 	mpz_t y;      /* öffentliches Y */
 } PublicData;
 
+typedef struct {      /* Vorberechnung für Logarithmen mod p, für alle Ziele gleich */
+	int n;                /* Anzahl der Faktoren von p-1 */
+	mpz_t p_1;            /* p-1 */
+	mpz_t *e_i;           /* (p-1) / p_i */
+	mpz_t *crt_c;         /* CRT-Koeffizienten, x = sum x_i * crt_c[i] mod (p-1) */
+	BSGSTable *tabs;      /* Baby-Step-Tabellen zu w_i = w ^ e_i */
+	GSWalk *walks;        /* Läufe für die Vektor-Engine */
+} DlogContext;
+
 
 /********************************************************************************/
 /*         Datenstruktur für die Kommunikation mit dem Signatur-Dämon           */
@@ -75,5 +118,117 @@ typedef struct {
 /********************************************************************************/
 
 void  Generate_MDC        ( const Message *msg, mpz_t p, mpz_t mdc);
+int   Generate_Nonce      ( mpz_t k, mpz_t x, mpz_t mdc, mpz_t n );
 int   Get_Public_Key      ( const String name, mpz_t y );
-int   Get_Private_Key     ( const char *filename, mpz_t p, mpz_t w, mpz_t x );
+int   Get_Private_Key     ( const char *filename, mpz_t p, mpz_t w, mpz_t x, mpz_t q );
+int   Get_All_Public_Keys ( const char *filename, PublicData **keys );
+int   Get_Param_Set       ( const char *name, mpz_t p, mpz_t w, mpz_t q );
+
+extern const ParamSet param_sets[];
+
+
+/********************************************************************************/
+/*              Prototypes der Funktionen aus mparena.c                         */
+/********************************************************************************/
+
+typedef struct {      /* Rücksprungpunkt für mp_arena_release() */
+	int chunk;
+	size_t used;
+} MPArenaMark;
+
+MPArenaMark mp_arena_mark ( void );
+void  mp_arena_release    ( MPArenaMark mark );
+void *mp_arena_alloc      ( size_t size );
+
+
+/********************************************************************************/
+/*              Prototypes der Funktionen aus metrics.c                         */
+/********************************************************************************/
+
+typedef enum {        /* gemessene Phasen der heißen Pfade */
+	M_MDC,              /* Generate_MDC: Hash und Quadrierungen */
+	M_NONCE,            /* Generate_Nonce: Ableiten von k, items = Kandidaten */
+	M_SIGN_POWM,        /* Generate_Sign: r = w^k mod p */
+	M_VERIFY_POWM,      /* Verify_Sign: je eine der drei Exponentiationen */
+	M_BSGS_BABY,        /* BSGS: Berechnen der Baby-Steps */
+	M_BSGS_INSERT,      /* BSGS: Sortieren der Baby-Steps (nur BSGS_GENERIC) */
+	M_BSGS_GIANT,       /* BSGS: Giant-Step-Lauf, items = Iterationen */
+	M_CRT,              /* dlogP: Chinesischer Restsatz */
+	M_NUM
+} MetricId;
+
+#ifdef METRICS
+#define METRIC_START(v)         uint64_t v = metrics_cycles()
+#define METRIC_STOP(id, v, n)   metrics_record((id), metrics_cycles() - (v), (n))
+#else
+#define METRIC_START(v)         ((void)0)
+#define METRIC_STOP(id, v, n)   ((void)0)
+#endif
+
+uint64_t metrics_cycles   ( void );
+void  metrics_record      ( MetricId id, uint64_t cycles, uint64_t items );
+int   metrics_dump        ( FILE *f, const char *format );
+
+
+/********************************************************************************/
+/*              Prototypes der Funktionen aus trace.c                           */
+/********************************************************************************/
+
+typedef enum { TRACE_ERROR, TRACE_WARN, TRACE_INFO, TRACE_DEBUG, TRACE_STEP } TraceLevel;
+
+typedef enum {        /* Ereignisse, Argumente siehe Tabelle in trace.c */
+	T_FACTORS, T_BSGS_TUNE, T_BSGS_TABLE, T_BSGS_BABY, T_BSGS_GIANT, T_BSGS_FOUND,
+	T_BSGS_FAIL, T_DLOG_FACTOR, T_DLOG_CRT, T_DLOG_RESULT, T_NONCE, T_SIGN, T_VERIFY,
+	T_NUM
+} TraceEvent;
+
+extern int trace_level;
+extern int trace_live;
+extern unsigned long trace_sample;
+
+/* Fingerabdruck einer Zahl: die untersten 64 Bit, auch bei 32-Bit-Limbs */
+#if GMP_NUMB_BITS == 64
+#define TRACE_FP(z)  ((uint64_t) mpz_getlimbn((z), 0))
+#elif GMP_NUMB_BITS == 32
+#define TRACE_FP(z)  ((uint64_t) mpz_getlimbn((z), 0) | (uint64_t) mpz_getlimbn((z), 1) << 32)
+#else
+#error "TRACE_FP: GMP mit 32- oder 64-Bit-Limbs erwartet"
+#endif
+
+#define TRACE(lvl, ev, a, b, c) do { \
+	if ((lvl) <= trace_level) \
+		trace_event((lvl), (ev), (uint64_t)(a), (uint64_t)(b), (uint64_t)(c)); \
+	} while (0)
+#define TRACE_STEP(ev, i, a) do { \
+	if (trace_level >= TRACE_STEP && (i) % trace_sample == 0) \
+		trace_event(TRACE_STEP, (ev), (uint64_t)(i), (uint64_t)(a), 0); \
+	} while (0)
+
+void  trace_event         ( int level, int event, uint64_t a, uint64_t b, uint64_t c );
+void  trace_dump          ( FILE *f );
+
+
+/********************************************************************************/
+/*              Prototypes der Funktionen aus gstep.c                           */
+/********************************************************************************/
+
+#define GS_MAXL      80            /* max. Anzahl 52-Bit-Limbs (Modulus bis 4096 Bit) */
+
+typedef struct {      /* K Giant-Step-Läufe mod p, Limbs als Structure of Arrays */
+	int K;                /* Anzahl Läufe, Vielfaches von 8 */
+	int L;                /* 52-Bit-Limbs pro Zahl */
+	uint64_t p[GS_MAXL];  /* Modulus */
+	uint64_t k0;          /* -p^(-1) mod 2^52 */
+	uint64_t *t;          /* Werte der Läufe, Limb j von Lauf k in t[j*K + k] */
+	uint64_t *m;          /* Faktoren der Läufe in Montgomery-Form, ebenso */
+	mpz_t mod;            /* p */
+	mpz_t R;              /* 2^(52L) mod p */
+	int ifma;             /* AVX-512 IFMA verfügbar */
+} GSBatch;
+
+void  gs_init             ( GSBatch *b, mpz_t p, int lanes );
+void  gs_clear            ( GSBatch *b );
+void  gs_set              ( GSBatch *b, int lane, mpz_t value, mpz_t mult );
+void  gs_get              ( GSBatch *b, int lane, mpz_t value );
+uint64_t gs_fp            ( GSBatch *b, int lane );
+void  gs_step             ( GSBatch *b );
@@ -13,6 +13,128 @@
 #include <unistd.h>
 #include "sign.h"
 
+
+/*
+ * Eingebaute Parametersätze: sichere Primzahlen p = 2q + 1 aus den
+ * MODP-Gruppen von RFC 2409/3526 mit w = 2 (signiert wird mod p-1), dazu
+ * Schnorr-Gruppen mit einer Untergruppe primer Ordnung q von 160 bzw. 256 Bit
+ * und w = 2^((p-1)/q) (signiert wird mod q). q und p der Schnorr-Gruppen
+ * sind aus festen SHA-256-Startwerten erzeugt und auf Primalität geprüft.
+ */
+const ParamSet param_sets[] = {
+	{ "modp1024", 1024,    /* RFC 2409, Gruppe 2 */
+		"FFFFFFFFFFFFFFFFC90FDAA22168C234C4C6628B80DC1CD129024E088A67CC74"
+		"020BBEA63B139B22514A08798E3404DDEF9519B3CD3A431B302B0A6DF25F1437"
+		"4FE1356D6D51C245E485B576625E7EC6F44C42E9A637ED6B0BFF5CB6F406B7ED"
+		"EE386BFB5A899FA5AE9F24117C4B1FE649286651ECE65381FFFFFFFFFFFFFFFF",
+		"2", NULL },
+	{ "modp1536", 1536,    /* RFC 3526, Gruppe 5 */
+		"FFFFFFFFFFFFFFFFC90FDAA22168C234C4C6628B80DC1CD129024E088A67CC74"
+		"020BBEA63B139B22514A08798E3404DDEF9519B3CD3A431B302B0A6DF25F1437"
+		"4FE1356D6D51C245E485B576625E7EC6F44C42E9A637ED6B0BFF5CB6F406B7ED"
+		"EE386BFB5A899FA5AE9F24117C4B1FE649286651ECE45B3DC2007CB8A163BF05"
+		"98DA48361C55D39A69163FA8FD24CF5F83655D23DCA3AD961C62F356208552BB"
+		"9ED529077096966D670C354E4ABC9804F1746C08CA237327FFFFFFFFFFFFFFFF",
+		"2", NULL },
+	{ "modp2048", 2048,    /* RFC 3526, Gruppe 14 */
+		"FFFFFFFFFFFFFFFFC90FDAA22168C234C4C6628B80DC1CD129024E088A67CC74"
+		"020BBEA63B139B22514A08798E3404DDEF9519B3CD3A431B302B0A6DF25F1437"
+		"4FE1356D6D51C245E485B576625E7EC6F44C42E9A637ED6B0BFF5CB6F406B7ED"
+		"EE386BFB5A899FA5AE9F24117C4B1FE649286651ECE45B3DC2007CB8A163BF05"
+		"98DA48361C55D39A69163FA8FD24CF5F83655D23DCA3AD961C62F356208552BB"
+		"9ED529077096966D670C354E4ABC9804F1746C08CA18217C32905E462E36CE3B"
+		"E39E772C180E86039B2783A2EC07A28FB5C55DF06F4C52C9DE2BCBF695581718"
+		"3995497CEA956AE515D2261898FA051015728E5A8AACAA68FFFFFFFFFFFFFFFF",
+		"2", NULL },
+	{ "modp3072", 3072,    /* RFC 3526, Gruppe 15 */
+		"FFFFFFFFFFFFFFFFC90FDAA22168C234C4C6628B80DC1CD129024E088A67CC74"
+		"020BBEA63B139B22514A08798E3404DDEF9519B3CD3A431B302B0A6DF25F1437"
+		"4FE1356D6D51C245E485B576625E7EC6F44C42E9A637ED6B0BFF5CB6F406B7ED"
+		"EE386BFB5A899FA5AE9F24117C4B1FE649286651ECE45B3DC2007CB8A163BF05"
+		"98DA48361C55D39A69163FA8FD24CF5F83655D23DCA3AD961C62F356208552BB"
+		"9ED529077096966D670C354E4ABC9804F1746C08CA18217C32905E462E36CE3B"
+		"E39E772C180E86039B2783A2EC07A28FB5C55DF06F4C52C9DE2BCBF695581718"
+		"3995497CEA956AE515D2261898FA051015728E5A8AAAC42DAD33170D04507A33"
+		"A85521ABDF1CBA64ECFB850458DBEF0A8AEA71575D060C7DB3970F85A6E1E4C7"
+		"ABF5AE8CDB0933D71E8C94E04A25619DCEE3D2261AD2EE6BF12FFA06D98A0864"
+		"D87602733EC86A64521F2B18177B200CBBE117577A615D6C770988C0BAD946E2"
+		"08E24FA074E5AB3143DB5BFCE0FD108E4B82D120A93AD2CAFFFFFFFFFFFFFFFF",
+		"2", NULL },
+	{ "modp4096", 4096,    /* RFC 3526, Gruppe 16 */
+		"FFFFFFFFFFFFFFFFC90FDAA22168C234C4C6628B80DC1CD129024E088A67CC74"
+		"020BBEA63B139B22514A08798E3404DDEF9519B3CD3A431B302B0A6DF25F1437"
+		"4FE1356D6D51C245E485B576625E7EC6F44C42E9A637ED6B0BFF5CB6F406B7ED"
+		"EE386BFB5A899FA5AE9F24117C4B1FE649286651ECE45B3DC2007CB8A163BF05"
+		"98DA48361C55D39A69163FA8FD24CF5F83655D23DCA3AD961C62F356208552BB"
+		"9ED529077096966D670C354E4ABC9804F1746C08CA18217C32905E462E36CE3B"
+		"E39E772C180E86039B2783A2EC07A28FB5C55DF06F4C52C9DE2BCBF695581718"
+		"3995497CEA956AE515D2261898FA051015728E5A8AAAC42DAD33170D04507A33"
+		"A85521ABDF1CBA64ECFB850458DBEF0A8AEA71575D060C7DB3970F85A6E1E4C7"
+		"ABF5AE8CDB0933D71E8C94E04A25619DCEE3D2261AD2EE6BF12FFA06D98A0864"
+		"D87602733EC86A64521F2B18177B200CBBE117577A615D6C770988C0BAD946E2"
+		"08E24FA074E5AB3143DB5BFCE0FD108E4B82D120A92108011A723C12A787E6D7"
+		"88719A10BDBA5B2699C327186AF4E23C1A946834B6150BDA2583E9CA2AD44CE8"
+		"DBBBC2DB04DE8EF92E8EFC141FBECAA6287C59474E6BC05D99B2964FA090C3A2"
+		"233BA186515BE7ED1F612970CEE2D7AFB81BDD762170481CD0069127D5B05AA9"
+		"93B4EA988D8FDDC186FFB7DC90A6C08F4DF435C934063199FFFFFFFFFFFFFFFF",
+		"2", NULL },
+	{ "schnorr1024", 1024, /* q mit 160 Bit */
+		"8E735E99F20364DF6B4419CB822FC1949C75F57EA3144BE7801EB22D42D5D315"
+		"A5275B8C9EF3658A587E3835DE06E1046C5851898414CC816EF8D39D72C36F92"
+		"5EDDA62292E59FEB936C95BC411716526DB5BD9265F4C89214F70F3F6EFDE18F"
+		"D2901B01FE3AD4C90117F7CFD64DBDD4C7BC1199AF2C97233E3BB425377B2FFD",
+		"281027EDA373CE828F2E96626121FC7C3C4FF061F229EA118740D63215A6B897"
+		"5EB7DBFEC2DED31DAD7CEE5D321F6D1D39BAA7862016BF3B23D10C661F8F2DCD"
+		"8D81621C9E3DFE868B558C6FFEC9812DE8DA4E4B9A563EE75AE905AAFAA74BA6"
+		"D3CD23C69C6D3475CC5F918BECCA01F6584A7E5E4883DB2FC17BB0B1FBA9C465",
+		"CA3E5D4ED98C294BF9375148E3C00CD606199223" },
+	{ "schnorr2048", 2048, /* q mit 256 Bit */
+		"B4F6C728DACDFC120F6790238E6F0EA839F30904638A87D239FE2301CF5A634D"
+		"C3BD82944821481F849AF4BD1062D1F9F278E953879E787D43DDD65AF834B9DB"
+		"419C245A4B6458809612532651C34F0CF4DD6C1095C4E7DD5D666FBC85B13A76"
+		"93E80CEF366165174834B75E2900171AE76F695A038C4A6A8B6EEFA8C452A0B1"
+		"6213BF7E924048F70B343FADBA13322CE4D8F5DA858E317973BD99BF3D76568B"
+		"578122233BCCDD79A5F0EF3B67D9BCD9B69E1BD783C90327D5F101587BB6A464"
+		"7099AEA8FD3D75DF1B4496BDF607D267599834D1397EF272369D5D46B8EC92A3"
+		"4284B6D8EC0E85794D211D7E52CF72F031D43448D3303C64F3ED155C2C258FCF",
+		"7CB7D7D23CBF6292452CC216568C48D01A4C8BC4E8675C30A647F7FFA33846C2"
+		"051B92929287BED6854787301CED7888FEDB6866C7CCF64D8EF970BA7057F4D7"
+		"5A9DEA6C9F68C4DD535285152467538BD4539ABFC76448F5CFADA02463B50E1E"
+		"CA134D5A96A879BFBF520D8E3B7EB05EB6F82C209B440347F02498CE82C6D8C9"
+		"37C85950BC632D98B39536908B931EB6BA43CEFE656267FBF90BD3F9FE6F36BD"
+		"9C92592463B6555E2665AF1D5267D7BEB1B77FE18C5D55EB508E595B19C35015"
+		"863D9DAEFF224016E0C3727EE29766ADC860C00E2DA4259E821946BEB4A57766"
+		"B589B0C69DC729FC3B70E440F022C48D2D03D8F91ED0C62A1F467201E70D8211",
+		"F3FEA83CB0799667B8F1799CAE54412EDB64637CAE3586583C364C675345ADC9" },
+	{ "schnorr3072", 3072, /* q mit 256 Bit */
+		"C672F7A9910EB75FC36D26270EC20C846C820BC94F974351EB378D533FA6348E"
+		"D4618E4127A41B95028A1A8AE2829CBA5F92952B3C970DEC3AC808CD5A89BFB7"
+		"6475129CA46C68B989B44A3003731A9CB42E2DB0ADBA771543CCE6E2125FB88D"
+		"764DFD8349C68320057C0A8CCDC99E79CC5DED209981F528133469A21AA54144"
+		"A40619091D5B8679880D4AB3E816B352935B98C0CA8A951A6D03230A763192F8"
+		"66AC9B95B5881D3BF2800D12E1F02C1D21555208270B9A402DA7F0577BE41B1C"
+		"03C85682434BF70BE951F8F6934A84EEE12E49429DB7C3F58E4CCCA5F091AC01"
+		"582BC86210E6BB74472E0319405481448B4985B045A840CEEADA31482450F6D7"
+		"763C840D6BA38E7F53EBD988DC2DE6E48FE7DC7834619C90C8ED493357A94BE4"
+		"A60387AAF44CD76CE30B29F7FEA5FA8046513AC0BC215C711FE9AAB36BB54C6D"
+		"15D0BF56C60C47D1A4CEA6A6671772B0B321681CD32C95CF86565A4A2B8151F6"
+		"4D36763C06630025BBED2D3FDA84684C6F7FEB5DDD218FBA3E5DC831CB84C857",
+		"984459078ADA5AE97D24F2479ED6D13B6431AF96A39542E99EA68FDC1FB901C2"
+		"A01E3EEFAC7E1E935A5F916C6004481354C5FEBBBA6D864E8C5848702315FC26"
+		"A667D48C785789B91F6E00361DA4CF1AC2BFFEC1E937CC022E75367067E6D7F4"
+		"C9248F3279CE8797268FD12DDDF6E7884C92CDCAE7490FC9045D3705F8880A45"
+		"DD87BA8F25B8D83016B1BA22CE0C2C46A392AC83BD70F8B1879BDBE429DFD8DE"
+		"274EF070927AED3D34213063F5E3072DE10DA5888E6B2D9D5BFAD43687BEAB18"
+		"AC429C3683707407615123F9100322E8E2A9A879B3B4CDC1E5FCB8EBC0F5C88D"
+		"E01FDB36ABE9CFCBDD3B3F61FD671DDAD0B61F3281401ED273AB335F6AF9D008"
+		"59194DB941C0269E4DF75879C73B3E4A568A07010C173D799FBF9AD7FB5FDC2D"
+		"38B8E033A081B4B1D2671B8C9B2E6EFBD949A4B28A341E004274A94428F8DBFE"
+		"334774E6AA2A2A82A85CE465CF8F734CB190A584D8F40B6B7C6945A890275B57"
+		"E140318D862DB6CD170A03DD9E6131243A9F0FED7A53E0E9E8B286B6DF3D20B6",
+		"F3FEA83CB0799667B8F1799CAE54412EDB64637CAE3586583C364C675345ADC9" },
+	{ 0 }
+};
+
 /*
  * Generate_MDC( msg, P, mdc ) :
  *
@@ -33,6 +155,7 @@ void Generate_MDC( const Message *msg, mpz_t p, mpz_t mdc)
     int len, j;
     mpz_t h;
     const UBYTE *ptr;
+    METRIC_START(t0);
 
     switch (msg->typ) {
       case ReportRequest:
@@ -77,11 +200,106 @@ void Generate_MDC( const Message *msg, mpz_t p, mpz_t mdc)
     for (j=0; j<8; j++)
       //LModSquare(mdc,mdc,p);
 			mpz_powm_ui(mdc, mdc, 2, p);
+    METRIC_STOP(M_MDC, t0, len);
 
   }
 
 
 
+/*
+ * hmac_md5(key, msg, len, out) : HMAC-MD5 (RFC 2104) mit 16-Byte-Schlüssel.
+ *   OUT darf mit KEY oder MSG übereinstimmen.
+ */
+static void hmac_md5(const UBYTE key[16], const UBYTE *msg, int len, UBYTE out[16])
+{
+	MD5_CTX m;
+	UBYTE ipad[64], opad[64], inner[16];
+	int i;
+
+	memset(ipad, 0x36, sizeof(ipad));
+	memset(opad, 0x5c, sizeof(opad));
+	for (i = 0; i < 16; i++) {
+		ipad[i] ^= key[i];
+		opad[i] ^= key[i];
+	}
+	MD5Init(&m);
+	MD5Update(&m, ipad, sizeof(ipad));
+	MD5Update(&m, msg, len);
+	MD5Final(inner, &m);
+
+	MD5Init(&m);
+	MD5Update(&m, opad, sizeof(opad));
+	MD5Update(&m, inner, 16);
+	MD5Final(out, &m);
+}
+
+/* Z (< 2^(8*len)) als LEN Bytes big-endian mit führenden Nullen */
+static void int2octets(UBYTE *buf, int len, mpz_t z)
+{
+	size_t count = (mpz_sizeinbase(z, 2) + 7) / 8;
+
+	memset(buf, 0, len);
+	mpz_export(buf + len - count, NULL, 1, 1, 1, 0, z);
+}
+
+/*
+ * Generate_Nonce(k, x, mdc, n) :
+ *
+ *   Leitet die Einmalzahl K für die Signatur der MDC mit dem geheimen
+ *   Schlüssel X deterministisch ab (HMAC_DRBG nach RFC 6979, Abschnitt 3.2,
+ *   mit HMAC-MD5). Kandidaten werden so lange weitergeschaltet, bis
+ *   1 <= k < n und ggT(k, n) = 1 gilt. Es gibt keinen gemeinsamen
+ *   Zufallszustand, beliebig viele Threads können gleichzeitig signieren.
+ *
+ * RETURN-Code: Anzahl der gezogenen Kandidaten.
+ */
+int Generate_Nonce(mpz_t k, mpz_t x, mpz_t mdc, mpz_t n)
+{
+	int qlen = mpz_sizeinbase(n, 2);
+	int rlen = (qlen + 7) / 8;
+	int tlen = (rlen + 15) / 16 * 16;
+	UBYTE K[16], *V, *T;
+	mpz_t h;
+	int i, tries = 0;
+
+	V = malloc(17 + 2 * rlen + tlen);   /* V || 0x00/0x01 || x || h, dahinter T */
+	T = V + 17 + 2 * rlen;
+	mpz_init(h);
+	mpz_mod(h, x, n);
+	int2octets(V + 17, rlen, h);
+	mpz_mod(h, mdc, n);
+	int2octets(V + 17 + rlen, rlen, h);
+
+	memset(V, 0x01, 16);
+	memset(K, 0x00, 16);
+	for (i = 0; i < 2; i++) {
+		V[16] = i;                        /* K = HMAC_K(V || i || x || h), V = HMAC_K(V) */
+		hmac_md5(K, V, 17 + 2 * rlen, K);
+		hmac_md5(K, V, 16, V);
+	}
+	for (;;) {
+		for (i = 0; i < tlen; i += 16) {
+			hmac_md5(K, V, 16, V);
+			memcpy(T + i, V, 16);
+		}
+		mpz_import(k, tlen, 1, 1, 1, 0, T);
+		mpz_tdiv_q_2exp(k, k, 8 * tlen - qlen);   /* bits2int: die linken qlen Bits */
+		tries++;
+		if (mpz_sgn(k) > 0 && mpz_cmp(k, n) < 0) {
+			mpz_gcd(h, k, n);
+			if (!mpz_cmp_ui(h, 1))
+				break;
+		}
+		V[16] = 0x00;                       /* K = HMAC_K(V || 0x00), V = HMAC_K(V) */
+		hmac_md5(K, V, 17, K);
+		hmac_md5(K, V, 16, V);
+	}
+	mpz_clear(h);
+	free(V);
+	return tries;
+}
+
+
 /*
  * Get_Public_Key(name,y) :
  *
@@ -124,6 +342,60 @@ int Get_Public_Key( const String name, mpz_t y)
 }
 
 
+/*
+ * Get_All_Public_Keys(filename,keys) :
+ *
+ *  Läd alle Einträge (Name, öffentliches Y) der Tabelle FILENAME nach
+ *  *KEYS. Wird NULL angegeben, so wird wie bei Get_Public_Key die
+ *  systemweite Tabelle benutzt. *KEYS wird mit malloc angelegt.
+ *
+ * RETURN-Code: Anzahl der Einträge, 0 bei Fehler.
+ */
+int Get_All_Public_Keys( const char *filename, PublicData **keys)
+{
+	FILE *f;
+	char *name = NULL;
+	const char *root;
+	char *line = NULL;
+	size_t bufsize = 0;
+	int n = 0, max = 16;
+
+	if (!filename) {
+		if (!(root=getenv("PRAKTROOT"))) if (!(root=getenv("HOME"))) root="";
+		filename = name = concatstrings(root,"/public_keys.data",NULL);
+	}
+	if (!(f=fopen(filename,"r"))) {
+		fprintf(stderr,"GET_ALL_PUBLIC_KEYS: Kann die Datei %s nicht öffnen: %s\n",filename,strerror(errno));
+		free(name);
+		return 0;
+	}
+	free(name);
+
+	*keys = malloc(max * sizeof(PublicData));
+	while (getline(&line,&bufsize,f)>0) {
+		line[strcspn(line,"\r\n")] = 0;
+		if (!*line) continue;
+		if (n == max) *keys = realloc(*keys, (max *= 2) * sizeof(PublicData));
+		strncpy((*keys)[n].name, line, sizeof(String)-1);
+		(*keys)[n].name[sizeof(String)-1] = 0;
+		mpz_init((*keys)[n].y);
+		if (getline(&line,&bufsize,f)<=0 || mpz_set_str((*keys)[n].y, line, 16)) {
+			fprintf(stderr,"GET_ALL_PUBLIC_KEYS: Kein gültiger Schlüssel für \"%s\"\n",(*keys)[n].name);
+			mpz_clear((*keys)[n].y);
+			continue;
+		}
+		n++;
+	}
+	free(line);
+	fclose(f);
+	if (!n) {
+		fprintf(stderr,"GET_ALL_PUBLIC_KEYS: Keine Schlüssel in der Tabelle\n");
+		free(*keys);
+	}
+	return n;
+}
+
+
 /*
  * Get_Privat_Key(filename,p,w,x) :
  *
@@ -220,21 +492,24 @@ void LXRand (mpz_t max, mpz_t z)
   }
 
 /*
- * Get_Private_Key(filename,p,w,x) :
+ * Get_Private_Key(filename,p,w,x,q) :
  *
  *  Läd den eigenen geheimen Schlüssel nach X. Die globalen (öffentlichen)
  *  Daten P und W werden ebenfalls aus dieser Datei geladen.
  *  FILENAME ist der Name der Datei, in der der geheime Schlüssel gespeichert
  *  ist. Wird NULL angegeben, so wird die Standarddatei "./privat_key.data" benutzt.
+ *  Eine optionale vierte Zeile gibt die Ordnung Q von W in einer
+ *  Schnorr-Gruppe an, X wird dann mod Q reduziert. Fehlt sie, ist Q = 0.
  *
  * RETURN-Code: 1 bei Erfolg, 0 sonst.
  */
 
-int Get_Private_Key(const char *filename, mpz_t p, mpz_t w, mpz_t x)
+int Get_Private_Key(const char *filename, mpz_t p, mpz_t w, mpz_t x, mpz_t q)
 {
 	FILE *f;
 	char *line = NULL;
-	size_t *bufsize = malloc(sizeof(int));
+	size_t *bufsize = malloc(sizeof(size_t));
+	mpz_t tmp;
 	*bufsize = 0;
 
 	if (!filename) filename = concatstrings(getenv("HOME"),"/private_key.data",NULL);
@@ -249,7 +524,51 @@ int Get_Private_Key(const char *filename, mpz_t p, mpz_t w, mpz_t x)
 		fclose(f);
 		return 0;
 	}
+	mpz_set_ui(q, 0);
+	if (getline(&line,bufsize,f) > 0 && line[strspn(line, " \t\r\n")]) {
+		mpz_init(tmp);
+		if (!mpz_set_str(q, line, 16) && mpz_sgn(q) > 0)
+			mpz_powm(tmp, w, q, p);
+		if (mpz_cmp_ui(tmp, 1)) {        // q must be the order of w
+			fprintf(stderr,"GET_PRIVAT_KEY: Ungültige Ordnung q in der Datei %s\n",filename);
+			mpz_set_ui(q, 0);
+			mpz_clear(tmp);
+			fclose(f);
+			return 0;
+		}
+		mpz_clear(tmp);
+		mpz_mod(x, x, q);
+	}
 	fclose(f);
 	return 1;
 }
 
+
+/*
+ * Get_Param_Set(name,p,w,q) :
+ *
+ *  Setzt P und W auf den eingebauten Parametersatz NAME ("modp2048") oder
+ *  den ersten mit der Bitlänge NAME ("2048"). Q wird die Ordnung von W bei
+ *  Schnorr-Gruppen, sonst 0.
+ *
+ * RETURN-Code: 1 bei Erfolg, 0 wenn es den Parametersatz nicht gibt.
+ */
+int Get_Param_Set(const char *name, mpz_t p, mpz_t w, mpz_t q)
+{
+	const ParamSet *ps;
+
+	for (ps = param_sets; ps->name; ps++)
+		if (!strcmp(name, ps->name) || atoi(name) == ps->bits)
+			break;
+	if (!ps->name) {
+		fprintf(stderr,"GET_PARAM_SET: Unbekannter Parametersatz \"%s\"\n",name);
+		return 0;
+	}
+	mpz_set_str(p, ps->p_hex, 16);
+	mpz_set_str(w, ps->w_hex, 16);
+	if (ps->q_hex)
+		mpz_set_str(q, ps->q_hex, 16);
+	else
+		mpz_set_ui(q, 0);
+	return 1;
+}
@@ -0,0 +1,101 @@
+/*************************************************************
+**         Europäisches Institut für Systemsicherheit        *
+**   Proktikum "Kryptographie und Datensicherheitstechnik"   *
+**                                                           *
+** Versuch 7: El-Gamal-Signatur                              *
+**                                                           *
+**************************************************************
+**
+** trace.c: Kompaktes Trace-Log mit Ringpuffer
+**
+** Jedes Ereignis ist ein Datensatz fester Größe (Zeitstempel, Ereignis,
+** Level, drei 64-Bit-Argumente). Große Zahlen werden nur über ihr unterstes
+** Limb (TRACE_FP) festgehalten. Die Datensätze landen in einem Ringpuffer
+** pro Thread, der erst bei einem Fehler mit trace_dump() ausgegeben wird;
+** trace_live gibt Ereignisse zusätzlich sofort aus. Einzelschritte
+** (TRACE_STEP) werden nur für jeden trace_sample-ten Schritt erfaßt, jedes
+** Ereignis kostet also O(1) und der Algorithmus bleibt in seiner Komplexität
+** unverändert.
+**/
+
+#include "sign.h"
+
+#define TRACE_RING 4096              /* Zweierpotenz */
+
+typedef struct {
+	uint64_t tsc;
+	uint16_t event;
+	uint8_t level;
+	uint64_t a, b, c;
+} TraceRecord;
+
+int trace_level = TRACE_INFO;        /* Ereignisse bis zu diesem Level aufzeichnen */
+int trace_live = -1;                 /* Ereignisse bis zu diesem Level sofort ausgeben */
+unsigned long trace_sample = 1;      /* bei TRACE_STEP nur jeden n-ten Schritt */
+
+static __thread TraceRecord ring[TRACE_RING];
+static __thread unsigned long head;  /* Anzahl bisher geschriebener Datensätze */
+
+static const char *level_names[] = { "ERROR", "WARN", "INFO", "DEBUG", "STEP" };
+
+static const struct {
+	const char *name;
+	const char *args;                  /* printf-Format für a, b, c */
+} events[T_NUM] = {
+	[T_FACTORS]     = { "factors",     "n=%llu p-1_ok=%llu" },
+	[T_BSGS_TUNE]   = { "bsgs_tune",   "insert_ns=%llu giant_ns=%llu ratio_milli=%llu" },
+	[T_BSGS_TABLE]  = { "bsgs_table",  "m=%llu steps=%llu p_i=%llx" },
+	[T_BSGS_BABY]   = { "bsgs_baby",   "j=%llu fp=%llx" },
+	[T_BSGS_GIANT]  = { "bsgs_giant",  "i=%llu fp=%llx" },
+	[T_BSGS_FOUND]  = { "bsgs_found",  "x_i=%llu i=%llu j=%llu" },
+	[T_BSGS_FAIL]   = { "bsgs_fail",   "steps=%llu m=%llu a_i=%llx" },
+	[T_DLOG_FACTOR] = { "dlog_factor", "i=%llu p_i=%llx a_i=%llx" },
+	[T_DLOG_CRT]    = { "dlog_crt",    "i=%llu x_i=%llx p_i=%llx" },
+	[T_DLOG_RESULT] = { "dlog_result", "x=%llx bits=%llu" },
+	[T_NONCE]       = { "nonce",       "tries=%llu" },
+	[T_SIGN]        = { "sign",        "m=%llx r=%llx s=%llx" },
+	[T_VERIFY]      = { "verify",      "ok=%llu lhs=%llx rhs=%llx" },
+};
+
+static void trace_print(FILE *f, const TraceRecord *t, uint64_t t0)
+{
+	fprintf(f, "%14llu %-5s %-11s ", (unsigned long long)(t->tsc - t0),
+			level_names[t->level], events[t->event].name);
+	fprintf(f, events[t->event].args, (unsigned long long)t->a,
+			(unsigned long long)t->b, (unsigned long long)t->c);
+	fputc('\n', f);
+}
+
+/*
+ * trace_event(level, event, a, b, c) : Schreibt einen Datensatz in den
+ *   Ringpuffer des aufrufenden Threads. Aufruf über TRACE()/TRACE_STEP().
+ */
+void trace_event(int level, int event, uint64_t a, uint64_t b, uint64_t c)
+{
+	TraceRecord *t = &ring[head++ & (TRACE_RING - 1)];
+
+	t->tsc = metrics_cycles();
+	t->event = event;
+	t->level = level;
+	t->a = a;
+	t->b = b;
+	t->c = c;
+	if (level <= trace_live)
+		trace_print(stderr, t, 0);
+}
+
+/*
+ * trace_dump(f) : Gibt den Ringpuffer des aufrufenden Threads vom ältesten
+ *   zum neuesten Datensatz nach F aus und leert ihn.
+ */
+void trace_dump(FILE *f)
+{
+	unsigned long i, first = head > TRACE_RING ? head - TRACE_RING : 0;
+
+	fprintf(f, "---- trace: %lu of %lu events ----\n", head - first, head);
+	for (i = first; i < head; i++)
+		trace_print(f, &ring[i & (TRACE_RING - 1)], ring[first & (TRACE_RING - 1)].tsc);
+	fprintf(f, "---- end of trace ----\n");
+	fflush(f);
+	head = 0;
+}